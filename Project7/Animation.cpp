@@ -167,4 +167,13 @@ void Animation::createAnimation(){
 	this->addKeyFrame(kf);
 }
 
+//
+// FUNCIN: Animation::getLength()
+//
+// PROPSITO: Obtiene la duracin del clip (instante del ltimo keyframe)
+//
+float Animation::getLength(){
+	if (vKeyframe.empty()) return 0.0f;
+	return vKeyframe.back().time;
+}
 
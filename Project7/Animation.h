@@ -20,5 +20,6 @@ class Animation{
 		void interpolationPose(std::string name, glm::vec2 vector);
 		void interpolationPose2(std::string name, CABalljoint* balljoint, glm::vec2 vector);
 		void createAnimation();
+		float getLength();
 };
 
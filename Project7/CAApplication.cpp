@@ -1,6 +1,7 @@
 #include "CAApplication.h"
 #include <windows.h>
 #include <iostream>
+#include <chrono>
 #include <vector>
 #include <glm/common.hpp>
 
@@ -11,14 +12,46 @@
 //
 void CAApplication::run()
 {
+	CAPresentSettings settings = {};
+	settings.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	settings.framesInFlight = 2;
+	settings.frameRateLimit = 0.0f;
+	settings.reportLatency = false;
+
 	this->window = initWindow();
-	this->vulkan = new CAVulkanState(window);
+	this->vulkan = new CAVulkanState(window, settings);
 	this->model = new CAModel(vulkan);
 	this->vulkan->setModel(model);
 	mainLoop();
 	cleanup();
 }
 
+//
+// FUNCIN: CAApplication::runHeadless(uint32_t frames, const char* dumpPath)
+//
+// PROPSITO: Ejecuta la aplicacin sin ventana ni superficie: genera el nmero de
+//            fotogramas indicado sobre imgenes propias y muestra el rendimiento.
+//            Sirve para medir en servidores sin pantalla (p.ej. con lavapipe).
+//            La simulacin avanza un paso fijo por fotograma, de modo que la imagen
+//            final, que se guarda en dumpPath si no es nulo, no depende de la mquina.
+//
+void CAApplication::runHeadless(uint32_t frames, const char* dumpPath)
+{
+	CAPresentSettings settings = {};
+	settings.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	settings.framesInFlight = 2;
+	settings.frameRateLimit = 0.0f;
+	settings.reportLatency = false;
+
+	this->window = nullptr;
+	this->vulkan = new CAVulkanState(WIDTH, HEIGHT, settings);
+	this->model = new CAModel(vulkan);
+	this->model->setFixedTimestep(HEADLESS_TIMESTEP);
+	this->vulkan->setModel(model);
+	headlessLoop(frames, dumpPath);
+	cleanup();
+}
+
 //
 // FUNCIN: CAApplication::initWindow()
 //
@@ -41,17 +74,45 @@ GLFWwindow* CAApplication::initWindow()
 //
 // FUNCIN: CAApplication::mainLoop()
 //
-// PROPSITO: Bucle principal que procesa los eventos de la aplicacin
+// PROPSITO: Bucle principal que procesa los eventos de la aplicacin. Los eventos
+//            se leen despus de esperar al hueco del fotograma para que la entrada
+//            sea lo ms reciente posible.
 //
 void CAApplication::mainLoop()
 {
 	while (!glfwWindowShouldClose(window))
 	{
+		vulkan->waitForFrameSlot();
 		glfwPollEvents();
 		vulkan->draw();
 	}
 }
 
+//
+// FUNCIN: CAApplication::headlessLoop(uint32_t frames, const char* dumpPath)
+//
+// PROPSITO: Genera frames fotogramas sin presentar y mide el tiempo total hasta que
+//            la GPU termina el ltimo. Despus guarda la ltima imagen si se pide.
+//
+void CAApplication::headlessLoop(uint32_t frames, const char* dumpPath)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < frames; i++)
+	{
+		vulkan->draw();
+	}
+	vulkan->finish();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << frames << " frames in " << seconds << " s (" << (seconds > 0.0 ? frames / seconds : 0.0) << " fps)" << std::endl;
+
+	if (dumpPath != nullptr)
+	{
+		vulkan->saveImage(dumpPath);
+		std::cout << "last frame saved to " << dumpPath << std::endl;
+	}
+}
+
 //
 // FUNCIN: CAApplication::cleanup()
 //
@@ -61,6 +122,7 @@ void CAApplication::cleanup()
 {
 	delete model;
 	delete vulkan;
+	if (window == nullptr) return;
 	glfwDestroyWindow(window);
 	glfwTerminate();
 }
@@ -73,6 +135,7 @@ void CAApplication::cleanup()
 void CAApplication::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
 	CAApplication* app = (CAApplication*)glfwGetWindowUserPointer(window);
+	app->vulkan->markInput();
 	if (action == GLFW_PRESS || action == GLFW_REPEAT) app->model->key_pressed(key);
 }
 
@@ -84,6 +147,7 @@ void CAApplication::keyCallback(GLFWwindow* window, int key, int scancode, int a
 void CAApplication::mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
 	CAApplication* app = (CAApplication*)glfwGetWindowUserPointer(window);
+	app->vulkan->markInput();
 	if (action == GLFW_PRESS || action == GLFW_REPEAT) app->model->mouse_button(button, action);
 }
 
@@ -95,6 +159,7 @@ void CAApplication::mouseButtonCallback(GLFWwindow* window, int button, int acti
 void CAApplication::cursorPositionCallback(GLFWwindow* window, double xpos, double ypos)
 {
 	CAApplication* app = (CAApplication*)glfwGetWindowUserPointer(window);
+	app->vulkan->markInput();
 	app->model->mouse_move(xpos, ypos);
 }
 
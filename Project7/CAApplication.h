@@ -4,14 +4,18 @@
 #include <GLFW/glfw3.h>
 #include "CAModel.h"
 #include "CAVulkanState.h"
+#include <cstdint>
 
 const int WIDTH = 800;
 const int HEIGHT = 600;
+// Paso de la simulacin por fotograma en modo sin ventana (segundos)
+const float HEADLESS_TIMESTEP = 1.0f / 60.0f;
 
 class CAApplication
 {
 public:
 	void run();
+	void runHeadless(uint32_t frames, const char* dumpPath);
 
 private:
 	GLFWwindow* window;
@@ -21,6 +25,7 @@ private:
 	// Mtodos principales
 	GLFWwindow* initWindow();
 	void mainLoop();
+	void headlessLoop(uint32_t frames, const char* dumpPath);
 	void cleanup();
 
 	// Respuesta a eventos
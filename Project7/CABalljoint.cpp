@@ -10,7 +10,7 @@
 CABalljoint::CABalljoint(std::string name, float l)
 {
 	length = l;
-	parentMatrix = glm::mat4(1.0f);
+	worldMatrix = glm::mat4(1.0f);
 	this->name = name;
 	location = glm::vec3(0.0f, 0.0f, 0.0f);
 	dir = glm::vec3(0.0f, 0.0f, 1.0f);
@@ -33,15 +33,12 @@ CABalljoint::CABalljoint(std::string name, float l)
 //
 CABalljoint::~CABalljoint()
 {
-	delete joint;
-	delete bone;
 	hijas.clear();
 }
 
 
 void CABalljoint::anadirHijo(CABalljoint* c) {
 	hijas.push_back(c);
-	ComputeMatrix();
 }
 
 void CABalljoint::setLimitX(GLfloat min, GLfloat max) {
@@ -60,11 +57,13 @@ void CABalljoint::setLimitZ(GLfloat min, GLfloat max) {
 }
 
 //
-// FUNCIN: CABalljoint::ComputeMatrix()
+// FUNCIN: CABalljoint::getLocalMatrix()
 //
-// PROPSITO: Crea la matriz de transformacin a partir de la posicin, la orientacin y la pose.
+// PROPSITO: Crea la matriz de transformacin respecto al extremo del hueso padre a partir
+//            de la posicin, la orientacin y la pose. La jerarqua completa se resuelve
+//            en CASkeleton::resolve().
 //
-void CABalljoint::ComputeMatrix()
+glm::mat4 CABalljoint::getLocalMatrix()
 {
 	// Formato glm::mat4[column][row]
 	glm::mat4 jointm;
@@ -116,22 +115,14 @@ void CABalljoint::ComputeMatrix()
 	posem[2][3] = 0;
 	posem[3][3] = 1;
 
-	glm::mat4 matrix = parentMatrix * jointm * posem;
-
-	joint->setLocation(matrix);
-	glm::mat4 mm = glm::translate(matrix, glm::vec3(0.0f, 0.0f, length / 2));
-	bone->setLocation(mm);
-
-	glm::mat4 mmHijas = glm::translate(matrix, glm::vec3(0.0f, 0.0f, length));
-	for (int i = 0; i < hijas.size(); i++) {
-		hijas[i]->setParentLocation(mmHijas);
-	}
+	return jointm * posem;
 }
 
 //
-// FUNCIN: CABalljoint::createBuffers(CAVulkanState* vulkan)
+// FUNCIN: CABalljoint::initialize(CAVulkanState* vulkan)
 //
-// PROPSITO: Inicializa las piezas de la figura
+// PROPSITO: Registra los materiales de las piezas. Las piezas no tienen buffers
+//            propios: se dibujan como instancias de una esfera y un cilindro comunes.
 //
 void CABalljoint::initialize(CAVulkanState* vulkan)
 {
@@ -141,9 +132,7 @@ void CABalljoint::initialize(CAVulkanState* vulkan)
 	jointMat.Ks = glm::vec3(0.8f, 0.8f, 0.8f);
 	jointMat.Shininess = 16.0f;
 
-	joint = new CASphere(10, 20, 0.1f);
-	joint->initialize(vulkan);
-	joint->setMaterial(jointMat);
+	jointMaterial = vulkan->registerMaterial(jointMat);
 
 	CAMaterial boneMat = {};
 	boneMat.Ka = glm::vec3(0.0f, 0.0f, 0.8f);
@@ -151,39 +140,24 @@ void CABalljoint::initialize(CAVulkanState* vulkan)
 	boneMat.Ks = glm::vec3(0.8f, 0.8f, 0.8f);
 	boneMat.Shininess = 16.0f;
 
-	bone = new CACylinder(2, 10, 0.05f, length / 2);
-	bone->initialize(vulkan);
-	bone->setMaterial(boneMat);
-	ComputeMatrix();
+	boneMaterial = vulkan->registerMaterial(boneMat);
+	setMatrix(getLocalMatrix());
 }
 
 //
-// FUNCIN: CABalljoint::updateUniformBuffers(CAVulkanState* vulkan, glm::mat4 view, glm::mat4 projection)
+// FUNCIN: CABalljoint::addInstances(CAInstanceBatch* joints, CAInstanceBatch* bones)
 //
-// PROPSITO: Actualiza las variables uniformes
+// PROPSITO: Aade la esfera de la articulacin y el cilindro del hueso a los lotes de
+//            instancias. El cilindro comn mide 2 de largo y se escala a la longitud
+//            del hueso. No se propaga a las hijas: CASkeleton recorre todas.
 //
-void CABalljoint::updateUniformBuffers(CAVulkanState* vulkan, glm::mat4 view, glm::mat4 projection)
+void CABalljoint::addInstances(CAInstanceBatch* joints, CAInstanceBatch* bones)
 {
-	joint->updateUniformBuffers(vulkan, view, projection);
-	bone->updateUniformBuffers(vulkan, view, projection);
-
-	for (int i = 0; i < hijas.size(); i++){
-		hijas[i]->updateUniformBuffers(vulkan, view, projection);
-	}
-}
+	joints->addInstance(worldMatrix, jointMaterial);
 
-//
-// FUNCIN: CABalljoint::finalize(CAVulkanState* vulkan)
-//
-// PROPSITO: Destruye los buffers de las piezas
-//
-void CABalljoint::finalize(CAVulkanState* vulkan)
-{
-	joint->finalize(vulkan);
-	bone->finalize(vulkan);
-	for (int i = 0; i < hijas.size(); i++) {
-		hijas[i]->finalize(vulkan);
-	}
+	glm::mat4 boneMatrix = glm::translate(worldMatrix, glm::vec3(0.0f, 0.0f, length / 2));
+	boneMatrix = glm::scale(boneMatrix, glm::vec3(1.0f, 1.0f, length / 2));
+	bones->addInstance(boneMatrix, boneMaterial);
 }
 
 //
@@ -194,7 +168,6 @@ void CABalljoint::finalize(CAVulkanState* vulkan)
 void CABalljoint::setLocation(glm::vec3 loc)
 {
 	location = loc;
-	ComputeMatrix();
 }
 
 //
@@ -207,7 +180,6 @@ void CABalljoint::setOrientation(glm::vec3 nDir, glm::vec3 nUp)
 	dir = nDir;
 	up = nUp;
 	right = glm::cross(up, dir);
-	ComputeMatrix();
 }
 
 //
@@ -243,51 +215,123 @@ void CABalljoint::setPose(float xrot, float yrot, float zrot)
 	else {
 		angles[2] = zrot;
 	}
+}
+
+//
+// FUNCIN: CABalljoint::setMatrix(glm::mat4 matrix)
+//
+// PROPSITO: Asigna la matriz de la articulacin en coordenadas del mundo. No se
+//            propaga a las hijas: lo usan CASkeleton::resolve() y el ragdoll, que
+//            recorren todas las articulaciones.
+//
+void CABalljoint::setMatrix(glm::mat4 matrix)
+{
+	worldMatrix = matrix;
+}
+
+std::string CABalljoint::getName()
+{
+	return this->name;
+}
 
-	ComputeMatrix();
+std::vector<CABalljoint*> CABalljoint::getHijas()
+{
+	return this->hijas;
 }
 
 //
-// FUNCIN: CABalljoint::addCommands(CAVulkanState* vulkan, VkCommandBuffer commandBuffer, int index)
+// FUNCIN: CABalljoint::getMatrix()
 //
-// PROPSITO: Aade los comandos de dibujo
+// PROPSITO: Obtiene la matriz de la articulacin en coordenadas del mundo
 //
-void CABalljoint::addCommands(CAVulkanState* vulkan, VkCommandBuffer commandBuffer, int index)
+glm::mat4 CABalljoint::getMatrix()
 {
-	joint->addCommands(vulkan, commandBuffer, index);
-	bone->addCommands(vulkan, commandBuffer, index);
-	for (int i = 0; i < hijas.size(); i++){
-		hijas[i]->addCommands(vulkan, commandBuffer, index);
-	}
+	return this->worldMatrix;
+}
+
+//
+// FUNCIN: CABalljoint::getDirection()
+//
+// PROPSITO: Obtiene la direccin del hueso respecto a su padre (con pose 0,0,0)
+//
+glm::vec3 CABalljoint::getDirection()
+{
+	return this->dir;
+}
 
+//
+// FUNCIN: CABalljoint::getOrientation()
+//
+// PROPSITO: Obtiene la orientacin respecto al padre con pose (0,0,0): columnas
+//            right, up y dir
+//
+glm::mat3 CABalljoint::getOrientation()
+{
+	return glm::mat3(right, up, dir);
 }
 
 //
-// FUNCIN: CABalljoint::setLight(CALight l)
+// FUNCIN: CABalljoint::getLength()
 //
-// PROPSITO: Asigna las propiedades de la luz
+// PROPSITO: Obtiene la longitud del hueso
 //
-void CABalljoint::setLight(CALight l)
+GLfloat CABalljoint::getLength()
 {
-	joint->setLight(l);
-	bone->setLight(l);
-	for (int i = 0; i < hijas.size(); i++) {
-		hijas[i]->setLight(l);
-	}
+	return this->length;
+}
 
+//
+// FUNCIN: CABalljoint::getJointMaterial()
+//
+// PROPSITO: Obtiene el ndice en la tabla de materiales de la esfera de la articulacin
+//
+uint32_t CABalljoint::getJointMaterial()
+{
+	return this->jointMaterial;
+}
+
+//
+// FUNCIN: CABalljoint::getBoneMaterial()
+//
+// PROPSITO: Obtiene el ndice en la tabla de materiales del cilindro del hueso
+//
+uint32_t CABalljoint::getBoneMaterial()
+{
+	return this->boneMaterial;
 }
 
-void CABalljoint::setParentLocation(glm::mat4 loc) {
-	parentMatrix = loc;
-	ComputeMatrix();
+//
+// FUNCIN: CABalljoint::poseRotation(glm::vec3 angles)
+//
+// PROPSITO: Rotacin de una pose (radianes) en el orden de CABalljoint: Z * Y * X
+//
+glm::mat3 CABalljoint::poseRotation(glm::vec3 angles)
+{
+	glm::mat4 m = glm::rotate(glm::mat4(1.0f), angles.z, glm::vec3(0.0f, 0.0f, 1.0f));
+	m = glm::rotate(m, angles.y, glm::vec3(0.0f, 1.0f, 0.0f));
+	m = glm::rotate(m, angles.x, glm::vec3(1.0f, 0.0f, 0.0f));
+	return glm::mat3(m);
 }
 
-std::string CABalljoint::getName()
+//
+// FUNCIN: CABalljoint::poseAngles(const glm::mat3& m)
+//
+// PROPSITO: ngulos X, Y y Z (radianes) de una rotacin Z * Y * X
+//
+glm::vec3 CABalljoint::poseAngles(const glm::mat3& m)
 {
-	return this->name;
+	float y = (float)asin(glm::clamp(-m[0][2], -1.0f, 1.0f));
+	float x = (float)atan2(m[1][2], m[2][2]);
+	float z = (float)atan2(m[0][1], m[0][0]);
+	return glm::vec3(x, y, z);
 }
 
-std::vector<CABalljoint*> CABalljoint::getHijas()
+//
+// FUNCIN: CABalljoint::getLimit()
+//
+// PROPSITO: Obtiene los lmites de rotacin (columna 0: mnimos, columna 1: mximos)
+//
+glm::mat2x3 CABalljoint::getLimit()
 {
-	return this->hijas;
+	return this->limit;
 }
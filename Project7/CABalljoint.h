@@ -1,7 +1,6 @@
 #pragma once
 
-#include "CASphere.h"
-#include "CACylinder.h"
+#include "CAInstanceBatch.h"
 #include <glm\glm.hpp>
 #include <string>
 
@@ -19,24 +18,20 @@ private:
 	glm::vec3 up;
 	glm::vec3 right;
 	GLfloat angles[3];
-	CASphere* joint;
-	CACylinder* bone;
+	uint32_t jointMaterial;
+	uint32_t boneMaterial;
 
 
 	std::vector<CABalljoint*> hijas;
 	glm::mat2x3 limit;
-	void ComputeMatrix();
-	glm::mat4 parentMatrix;
+	glm::mat4 worldMatrix;
 	
 public:
 	CABalljoint(std::string name, float length);
 	~CABalljoint();
 	void initialize(CAVulkanState* vulkan);
-	void finalize(CAVulkanState* vulkan);
-	void addCommands(CAVulkanState* vulkan, VkCommandBuffer commandBuffer, int index);
-	void updateUniformBuffers(CAVulkanState* vulkan, glm::mat4 view, glm::mat4 projection);
+	void addInstances(CAInstanceBatch* joints, CAInstanceBatch* bones);
 	void setMatrix(glm::mat4 matrix);
-	void setLight(CALight l);
 	void setLocation(glm::vec3 loc);
 	void setOrientation(glm::vec3 nDir, glm::vec3 nUp);
 	void setPose(float xrot, float yrot, float zrot);
@@ -44,9 +39,18 @@ public:
 	void setLimitX(GLfloat min, GLfloat max);
 	void setLimitY(GLfloat min, GLfloat max);
 	void setLimitZ(GLfloat min, GLfloat max);
-	void setParentLocation(glm::mat4 l);
 	std::string getName();
 	std::vector<CABalljoint*> getHijas();
+	glm::mat4 getMatrix();
+	glm::mat4 getLocalMatrix();
+	glm::vec3 getDirection();
+	glm::mat3 getOrientation();
+	GLfloat getLength();
+	glm::mat2x3 getLimit();
+	uint32_t getJointMaterial();
+	uint32_t getBoneMaterial();
+	static glm::mat3 poseRotation(glm::vec3 angles);
+	static glm::vec3 poseAngles(const glm::mat3& m);
 };
 
 
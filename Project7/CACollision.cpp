@@ -0,0 +1,426 @@
+#include "CACollision.h"
+#include <xmmintrin.h>
+#include <algorithm>
+#include <cmath>
+
+#define COLLISION_PAIRS_PER_JOB 64
+#define COLLISION_EPSILON 1e-6f
+// Holgura para considerar apoyado un hueso que roza el suelo sin penetrarlo
+#define COLLISION_GROUND_TOLERANCE 0.02f
+
+//
+// FUNCIN: blend4(__m128 mask, __m128 a, __m128 b)
+//
+// PROPSITO: Elige por carril a (mscara activa) o b
+//
+static inline __m128 blend4(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+//
+// FUNCIN: clamp01(__m128 v)
+//
+// PROPSITO: Limita cada carril al intervalo [0, 1]
+//
+static inline __m128 clamp01(__m128 v)
+{
+	return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+}
+
+//
+// FUNCIN: dot3(...)
+//
+// PROPSITO: Producto escalar de cuatro parejas de vectores en formato SoA
+//
+static inline __m128 dot3(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+
+//
+// FUNCIN: CACollisionWorld::CACollisionWorld(CAJobSystem* jobs, float groundWidth, float groundDepth, float groundHeight)
+//
+// PROPSITO: Construye el mundo de colisiones. El suelo es el rectngulo de semiejes
+//            groundWidth x groundDepth del CAGround, situado a la altura groundHeight.
+//
+CACollisionWorld::CACollisionWorld(CAJobSystem* jobs, float groundWidth, float groundDepth, float groundHeight)
+{
+	this->jobs = jobs;
+	this->groundWidth = groundWidth;
+	this->groundDepth = groundDepth;
+	this->groundHeight = groundHeight;
+	this->workerContacts.resize(jobs->getWorkerCount());
+}
+
+//
+// FUNCIN: CACollisionWorld::~CACollisionWorld()
+//
+// PROPSITO: Destruye el mundo de colisiones (los esqueletos no son de su propiedad)
+//
+CACollisionWorld::~CACollisionWorld()
+{
+	skeletons.clear();
+}
+
+//
+// FUNCIN: CACollisionWorld::addSkeleton(CASkeleton* skeleton, float radius)
+//
+// PROPSITO: Registra un personaje. Todos sus huesos usan el mismo radio.
+//
+int CACollisionWorld::addSkeleton(CASkeleton* skeleton, float radius)
+{
+	skeletons.push_back(skeleton);
+	radii.push_back(radius);
+	return (int)skeletons.size() - 1;
+}
+
+//
+// FUNCIN: CACollisionWorld::removeSkeleton(CASkeleton* skeleton)
+//
+// PROPSITO: Elimina un personaje del mundo de colisiones
+//
+void CACollisionWorld::removeSkeleton(CASkeleton* skeleton)
+{
+	for (size_t i = 0; i < skeletons.size(); i++)
+	{
+		if (skeletons[i] == skeleton)
+		{
+			skeletons.erase(skeletons.begin() + i);
+			radii.erase(radii.begin() + i);
+			return;
+		}
+	}
+}
+
+//
+// FUNCIN: CACollisionWorld::update()
+//
+// PROPSITO: Recalcula las cpsulas a partir de la pose actual y genera los contactos
+//
+void CACollisionWorld::update()
+{
+	gatherCapsules();
+	broadphase();
+
+	contacts.clear();
+	groundContacts();
+	narrowphase();
+}
+
+//
+// FUNCIN: CACollisionWorld::getContacts()
+//
+// PROPSITO: Obtiene los contactos calculados en la ltima actualizacin
+//
+const std::vector<CAContact>& CACollisionWorld::getContacts()
+{
+	return contacts;
+}
+
+//
+// FUNCIN: CACollisionWorld::getCapsules()
+//
+// PROPSITO: Obtiene las cpsulas usadas en la ltima actualizacin
+//
+const std::vector<CACapsule>& CACollisionWorld::getCapsules()
+{
+	return capsules;
+}
+
+//
+// FUNCIN: CACollisionWorld::isTouchingGround(CASkeleton* skeleton, const std::string& joint)
+//
+// PROPSITO: Indica si el hueso con ese nombre (p.ej. "ankle_l") toca el suelo. Con el
+//            radio de los huesos un pie apoyado apenas roza el plano, por lo que basta
+//            con que el extremo ms bajo quede a menos de COLLISION_GROUND_TOLERANCE.
+//
+bool CACollisionWorld::isTouchingGround(CASkeleton* skeleton, const std::string& joint)
+{
+	for (size_t i = 0; i < capsules.size(); i++)
+	{
+		const CACapsule& c = capsules[i];
+		if (skeletons[c.owner] != skeleton || c.joint->getName() != joint) continue;
+
+		glm::vec3 low = (c.a.y < c.b.y) ? c.a : c.b;
+		if (fabs(low.x) > groundWidth || fabs(low.z) > groundDepth) continue;
+		if (low.y - c.radius <= groundHeight + COLLISION_GROUND_TOLERANCE) return true;
+	}
+	return false;
+}
+
+//
+// FUNCIN: CACollisionWorld::isOverlapping(CASkeleton* skeleton)
+//
+// PROPSITO: Indica si algn hueso del personaje se solapa con otro personaje
+//
+bool CACollisionWorld::isOverlapping(CASkeleton* skeleton)
+{
+	for (size_t i = 0; i < contacts.size(); i++)
+	{
+		if (contacts[i].capsuleB < 0) continue;
+
+		if (skeletons[capsules[contacts[i].capsuleA].owner] == skeleton) return true;
+		if (skeletons[capsules[contacts[i].capsuleB].owner] == skeleton) return true;
+	}
+	return false;
+}
+
+//
+// FUNCIN: CACollisionWorld::gatherCapsules()
+//
+// PROPSITO: Genera una cpsula por hueso con las matrices actuales de las articulaciones
+//
+void CACollisionWorld::gatherCapsules()
+{
+	capsules.clear();
+	for (size_t i = 0; i < skeletons.size(); i++)
+	{
+		std::vector<CABalljoint*> roots = skeletons[i]->getHijas();
+		for (size_t j = 0; j < roots.size(); j++)
+		{
+			addCapsules(roots[j], (int)i);
+		}
+	}
+
+	boundsMin.resize(capsules.size());
+	boundsMax.resize(capsules.size());
+	for (size_t i = 0; i < capsules.size(); i++)
+	{
+		glm::vec3 r = glm::vec3(capsules[i].radius);
+		boundsMin[i] = glm::min(capsules[i].a, capsules[i].b) - r;
+		boundsMax[i] = glm::max(capsules[i].a, capsules[i].b) + r;
+	}
+}
+
+//
+// FUNCIN: CACollisionWorld::addCapsules(CABalljoint* joint, int owner)
+//
+// PROPSITO: Aade la cpsula de la articulacin y de todas sus hijas
+//
+void CACollisionWorld::addCapsules(CABalljoint* joint, int owner)
+{
+	glm::mat4 m = joint->getMatrix();
+
+	CACapsule c;
+	c.a = glm::vec3(m[3]);
+	c.b = glm::vec3(m * glm::vec4(0.0f, 0.0f, joint->getLength(), 1.0f));
+	c.radius = radii[owner];
+	c.owner = owner;
+	c.joint = joint;
+	capsules.push_back(c);
+
+	std::vector<CABalljoint*> hijas = joint->getHijas();
+	for (size_t i = 0; i < hijas.size(); i++)
+	{
+		addCapsules(hijas[i], owner);
+	}
+}
+
+//
+// FUNCIN: CACollisionWorld::broadphase()
+//
+// PROPSITO: Barrido y poda en el eje X. El orden se conserva entre actualizaciones,
+//            por lo que la ordenacin por insercin es casi lineal cuando los
+//            personajes se mueven poco de un paso al siguiente.
+//
+void CACollisionWorld::broadphase()
+{
+	if (order.size() != capsules.size())
+	{
+		order.resize(capsules.size());
+		for (size_t i = 0; i < order.size(); i++) order[i] = (int)i;
+	}
+
+	for (size_t i = 1; i < order.size(); i++)
+	{
+		int key = order[i];
+		float x = boundsMin[key].x;
+		size_t j = i;
+		while (j > 0 && boundsMin[order[j - 1]].x > x)
+		{
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = key;
+	}
+
+	pairs.clear();
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		int a = order[i];
+		for (size_t j = i + 1; j < order.size(); j++)
+		{
+			int b = order[j];
+			if (boundsMin[b].x > boundsMax[a].x) break;
+			if (capsules[a].owner == capsules[b].owner) continue;
+			if (boundsMin[b].y > boundsMax[a].y || boundsMin[a].y > boundsMax[b].y) continue;
+			if (boundsMin[b].z > boundsMax[a].z || boundsMin[a].z > boundsMax[b].z) continue;
+
+			Pair p = { a, b };
+			pairs.push_back(p);
+		}
+	}
+}
+
+//
+// FUNCIN: CACollisionWorld::groundContacts()
+//
+// PROPSITO: Contactos de los huesos con el suelo. Se usa el extremo ms bajo de
+//            cada cpsula que est dentro de los lmites del suelo.
+//
+void CACollisionWorld::groundContacts()
+{
+	for (size_t i = 0; i < capsules.size(); i++)
+	{
+		const CACapsule& c = capsules[i];
+		glm::vec3 low = (c.a.y < c.b.y) ? c.a : c.b;
+		float depth = groundHeight - (low.y - c.radius);
+		if (depth <= 0.0f) continue;
+		if (fabs(low.x) > groundWidth || fabs(low.z) > groundDepth) continue;
+
+		CAContact contact;
+		contact.capsuleA = (int)i;
+		contact.capsuleB = -1;
+		contact.point = glm::vec3(low.x, groundHeight, low.z);
+		contact.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+		contact.depth = depth;
+		contacts.push_back(contact);
+	}
+}
+
+//
+// FUNCIN: CACollisionWorld::narrowphase()
+//
+// PROPSITO: Reparte las parejas de la fase amplia entre los hilos y rene los contactos
+//
+void CACollisionWorld::narrowphase()
+{
+	size_t chunks = (pairs.size() + COLLISION_PAIRS_PER_JOB - 1) / COLLISION_PAIRS_PER_JOB;
+	for (size_t i = 0; i < workerContacts.size(); i++) workerContacts[i].clear();
+
+	jobs->parallelFor(chunks, [this](size_t index, uint32_t worker) {
+		size_t first = index * COLLISION_PAIRS_PER_JOB;
+		size_t count = std::min((size_t)COLLISION_PAIRS_PER_JOB, pairs.size() - first);
+		testPairs(first, count, workerContacts[worker]);
+	});
+
+	for (size_t i = 0; i < workerContacts.size(); i++)
+	{
+		contacts.insert(contacts.end(), workerContacts[i].begin(), workerContacts[i].end());
+	}
+}
+
+//
+// FUNCIN: CACollisionWorld::testPairs(size_t first, size_t count, std::vector<CAContact>& out)
+//
+// PROPSITO: Fase estrecha cpsula-cpsula. Calcula los puntos ms cercanos entre los
+//            dos segmentos de cuatro parejas a la vez y genera un contacto si su
+//            distancia es menor que la suma de los radios.
+//
+void CACollisionWorld::testPairs(size_t first, size_t count, std::vector<CAContact>& out)
+{
+	alignas(16) float p1[3][4], d1[3][4], p2[3][4], d2[3][4], rs[4];
+	alignas(16) float c1[3][4], c2[3][4], dist2[4];
+
+	for (size_t base = 0; base < count; base += 4)
+	{
+		int lanes = (int)std::min((size_t)4, count - base);
+
+		// Los carriles sobrantes repiten la ltima pareja y se descartan con la mscara
+		for (int l = 0; l < 4; l++)
+		{
+			const Pair& p = pairs[first + base + std::min(l, lanes - 1)];
+			const CACapsule& a = capsules[p.a];
+			const CACapsule& b = capsules[p.b];
+			for (int k = 0; k < 3; k++)
+			{
+				p1[k][l] = a.a[k];
+				d1[k][l] = a.b[k] - a.a[k];
+				p2[k][l] = b.a[k];
+				d2[k][l] = b.b[k] - b.a[k];
+			}
+			rs[l] = a.radius + b.radius;
+		}
+
+		__m128 p1x = _mm_load_ps(p1[0]), p1y = _mm_load_ps(p1[1]), p1z = _mm_load_ps(p1[2]);
+		__m128 d1x = _mm_load_ps(d1[0]), d1y = _mm_load_ps(d1[1]), d1z = _mm_load_ps(d1[2]);
+		__m128 p2x = _mm_load_ps(p2[0]), p2y = _mm_load_ps(p2[1]), p2z = _mm_load_ps(p2[2]);
+		__m128 d2x = _mm_load_ps(d2[0]), d2y = _mm_load_ps(d2[1]), d2z = _mm_load_ps(d2[2]);
+		__m128 rx = _mm_sub_ps(p1x, p2x), ry = _mm_sub_ps(p1y, p2y), rz = _mm_sub_ps(p1z, p2z);
+
+		__m128 a = dot3(d1x, d1y, d1z, d1x, d1y, d1z);
+		__m128 e = dot3(d2x, d2y, d2z, d2x, d2y, d2z);
+		__m128 b = dot3(d1x, d1y, d1z, d2x, d2y, d2z);
+		__m128 c = dot3(d1x, d1y, d1z, rx, ry, rz);
+		__m128 f = dot3(d2x, d2y, d2z, rx, ry, rz);
+		__m128 zero = _mm_setzero_ps();
+		__m128 one = _mm_set1_ps(1.0f);
+
+		// Segmentos de longitud nula (a o e casi 0): se dividen por 1 y despus se
+		// sustituye el resultado por el del caso degenerado
+		__m128 epsilon = _mm_set1_ps(COLLISION_EPSILON);
+		__m128 pointA = _mm_cmple_ps(a, epsilon);
+		__m128 pointE = _mm_cmple_ps(e, epsilon);
+		__m128 safeA = blend4(pointA, one, a);
+		__m128 safeE = blend4(pointE, one, e);
+
+		// Parmetro s sobre el primer segmento (0 si los segmentos son paralelos)
+		__m128 denom = _mm_sub_ps(_mm_mul_ps(a, e), _mm_mul_ps(b, b));
+		__m128 parallel = _mm_cmple_ps(denom, epsilon);
+		__m128 safeDenom = blend4(parallel, one, denom);
+		__m128 s = clamp01(_mm_div_ps(_mm_sub_ps(_mm_mul_ps(b, f), _mm_mul_ps(c, e)), safeDenom));
+		s = blend4(parallel, zero, s);
+
+		// Parmetro t sobre el segundo segmento; si se sale de [0, 1] se recalcula s
+		__m128 t = _mm_div_ps(_mm_add_ps(_mm_mul_ps(b, s), f), safeE);
+		__m128 tLow = _mm_cmplt_ps(t, zero);
+		__m128 tHigh = _mm_cmpgt_ps(t, one);
+		__m128 sLow = clamp01(_mm_div_ps(_mm_sub_ps(zero, c), safeA));
+		__m128 sHigh = clamp01(_mm_div_ps(_mm_sub_ps(b, c), safeA));
+		s = blend4(tLow, sLow, blend4(tHigh, sHigh, s));
+		t = clamp01(t);
+
+		// Segundo segmento puntual: t = 0 y s es la proyeccin sobre el primero.
+		// Primer segmento puntual: s = 0 y t la proyeccin sobre el segundo (0 si
+		// los dos son puntos).
+		s = blend4(pointE, sLow, s);
+		t = blend4(pointE, zero, t);
+		s = blend4(pointA, zero, s);
+		t = blend4(pointA, blend4(pointE, zero, clamp01(_mm_div_ps(f, safeE))), t);
+
+		__m128 c1x = _mm_add_ps(p1x, _mm_mul_ps(d1x, s));
+		__m128 c1y = _mm_add_ps(p1y, _mm_mul_ps(d1y, s));
+		__m128 c1z = _mm_add_ps(p1z, _mm_mul_ps(d1z, s));
+		__m128 c2x = _mm_add_ps(p2x, _mm_mul_ps(d2x, t));
+		__m128 c2y = _mm_add_ps(p2y, _mm_mul_ps(d2y, t));
+		__m128 c2z = _mm_add_ps(p2z, _mm_mul_ps(d2z, t));
+		__m128 dx = _mm_sub_ps(c1x, c2x), dy = _mm_sub_ps(c1y, c2y), dz = _mm_sub_ps(c1z, c2z);
+		__m128 d = dot3(dx, dy, dz, dx, dy, dz);
+		__m128 r = _mm_load_ps(rs);
+
+		int hits = _mm_movemask_ps(_mm_cmplt_ps(d, _mm_mul_ps(r, r))) & ((1 << lanes) - 1);
+		if (hits == 0) continue;
+
+		_mm_store_ps(c1[0], c1x); _mm_store_ps(c1[1], c1y); _mm_store_ps(c1[2], c1z);
+		_mm_store_ps(c2[0], c2x); _mm_store_ps(c2[1], c2y); _mm_store_ps(c2[2], c2z);
+		_mm_store_ps(dist2, d);
+
+		for (int l = 0; l < lanes; l++)
+		{
+			if ((hits & (1 << l)) == 0) continue;
+
+			glm::vec3 pa = glm::vec3(c1[0][l], c1[1][l], c1[2][l]);
+			glm::vec3 pb = glm::vec3(c2[0][l], c2[1][l], c2[2][l]);
+			float dist = sqrtf(dist2[l]);
+
+			CAContact contact;
+			contact.capsuleA = pairs[first + base + l].a;
+			contact.capsuleB = pairs[first + base + l].b;
+			contact.normal = (dist > COLLISION_EPSILON) ? (pa - pb) / dist : glm::vec3(0.0f, 1.0f, 0.0f);
+			contact.depth = rs[l] - dist;
+			contact.point = (pa + pb) * 0.5f;
+			out.push_back(contact);
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "CASkeleton.h"
+#include "CAJobSystem.h"
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+//
+// ESTRUCTURA: CACapsule
+//
+// DESCRIPCIN: Hueso representado como cpsula (segmento a-b con radio). Es la misma
+//              forma que se dibuja: un CACylinder con un CASphere en la articulacin.
+//
+struct CACapsule {
+	glm::vec3 a;
+	glm::vec3 b;
+	float radius;
+	int owner;
+	CABalljoint* joint;
+};
+
+//
+// ESTRUCTURA: CAContact
+//
+// DESCRIPCIN: Contacto entre dos cpsulas, o entre una cpsula y el suelo (capsuleB = -1).
+//              La normal apunta de B hacia A.
+//
+struct CAContact {
+	int capsuleA;
+	int capsuleB;
+	glm::vec3 point;
+	glm::vec3 normal;
+	float depth;
+};
+
+//
+// CLASE: CACollisionWorld
+//
+// DESCRIPCIN: Deteccin de colisiones entre huesos de distintos personajes y entre
+//              huesos y el suelo (CAGround, plano y = height). Fase amplia por barrido
+//              y poda (sweep and prune) en el eje X y fase estrecha cpsula-cpsula
+//              evaluando cuatro parejas a la vez con SSE.
+//
+class CACollisionWorld
+{
+public:
+	CACollisionWorld(CAJobSystem* jobs, float groundWidth, float groundDepth, float groundHeight = 0.0f);
+	~CACollisionWorld();
+	int addSkeleton(CASkeleton* skeleton, float radius);
+	void removeSkeleton(CASkeleton* skeleton);
+	void update();
+	const std::vector<CAContact>& getContacts();
+	const std::vector<CACapsule>& getCapsules();
+	bool isTouchingGround(CASkeleton* skeleton, const std::string& joint);
+	bool isOverlapping(CASkeleton* skeleton);
+
+private:
+	struct Pair {
+		int a;
+		int b;
+	};
+
+	CAJobSystem* jobs;
+	float groundWidth;
+	float groundDepth;
+	float groundHeight;
+
+	std::vector<CASkeleton*> skeletons;
+	std::vector<float> radii;
+	std::vector<CACapsule> capsules;
+	std::vector<glm::vec3> boundsMin;
+	std::vector<glm::vec3> boundsMax;
+	std::vector<int> order;
+	std::vector<Pair> pairs;
+	std::vector<std::vector<CAContact>> workerContacts;
+	std::vector<CAContact> contacts;
+
+	void gatherCapsules();
+	void addCapsules(CABalljoint* joint, int owner);
+	void broadphase();
+	void narrowphase();
+	void groundContacts();
+	void testPairs(size_t first, size_t count, std::vector<CAContact>& out);
+};
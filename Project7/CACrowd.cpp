@@ -0,0 +1,403 @@
+#include "CACrowd.h"
+#include <algorithm>
+#include <cmath>
+
+#define CROWD_GOAL_WEIGHT 2.0f
+#define CROWD_SEPARATION_WEIGHT 1.5f
+#define CROWD_ALIGNMENT_WEIGHT 0.5f
+#define CROWD_SEPARATION_RADIUS 0.6f
+#define CROWD_GOAL_RADIUS 0.5f
+#define CROWD_GOAL_MARGIN 0.5f
+#define CROWD_TURN_SPEED 0.2f
+#define CROWD_MAX_STEP 0.1f
+
+// Tiempo de animacin por metro recorrido: el clip de andar avanza lo mismo que la raz
+#define CROWD_CLIP_PER_METRE 1.0f
+
+//
+// FUNCIN: CACrowd::CACrowd(CAJobSystem* jobs, float groundWidth, float groundDepth, float cellSize)
+//
+// PROPSITO: Construye la multitud. Los agentes se mueven dentro del rectngulo de
+//            semiejes groundWidth x groundDepth; cellSize es el lado de las celdas
+//            de la tabla hash y debe ser mayor que el radio de vecindad.
+//
+CACrowd::CACrowd(CAJobSystem* jobs, float groundWidth, float groundDepth, float cellSize)
+{
+	this->jobs = jobs;
+	this->groundWidth = groundWidth;
+	this->groundDepth = groundDepth;
+	this->cellSize = cellSize;
+	this->maxSpeed = 1.2f;
+	this->timeScale = 1.0f;
+	this->procedural = true;
+	this->tableMask = 0;
+}
+
+//
+// FUNCIN: CACrowd::~CACrowd()
+//
+// PROPSITO: Destruye la multitud (los esqueletos y animaciones no son de su propiedad)
+//
+CACrowd::~CACrowd()
+{
+	agents.clear();
+}
+
+//
+// FUNCIN: CACrowd::addAgent(CASkeleton* skeleton, Animation* animation, CAGait* gait, glm::vec2 position, glm::vec2 heading)
+//
+// PROPSITO: Aade un personaje a la multitud con la posicin y orientacin iniciales.
+//            Anda con el clip animation o con el generador procedural gait.
+//
+int CACrowd::addAgent(CASkeleton* skeleton, Animation* animation, CAGait* gait, glm::vec2 position, glm::vec2 heading)
+{
+	CAAgent agent;
+	agent.position = position;
+	agent.heading = glm::normalize(heading);
+	agent.velocity = glm::vec2(0.0f, 0.0f);
+	agent.height = skeleton->getLocation()[3].y;
+	agent.clipTime = 0.0f;
+	agent.seed = 0x9E3779B9u * (uint32_t)(agents.size() + 1);
+	agent.goal = randomGoal(agent.seed);
+	agent.seed = agent.seed * 1664525u + 1013904223u;
+	agent.speedFactor = 0.75f + 0.5f * (float)(agent.seed >> 8) / 16777216.0f;
+	agent.enabled = true;
+	agent.skeleton = skeleton;
+	agent.animation = animation;
+	agent.gait = gait;
+	agents.push_back(agent);
+	steering.push_back(glm::vec2(0.0f, 0.0f));
+	return (int)agents.size() - 1;
+}
+
+//
+// FUNCIN: CACrowd::removeAgent(CASkeleton* skeleton)
+//
+// PROPSITO: Elimina de la multitud el agente de un esqueleto. Los ndices de los
+//            agentes posteriores se desplazan una posicin.
+//
+void CACrowd::removeAgent(CASkeleton* skeleton)
+{
+	for (size_t i = 0; i < agents.size(); i++)
+	{
+		if (agents[i].skeleton == skeleton)
+		{
+			agents.erase(agents.begin() + i);
+			steering.erase(steering.begin() + i);
+			return;
+		}
+	}
+}
+
+//
+// FUNCIN: CACrowd::setEnabled(int agent, bool enabled)
+//
+// PROPSITO: Activa o desactiva el guiado de un agente (p.ej. mientras es un ragdoll).
+//            Un agente desactivado sigue siendo un obstculo para los dems. Al
+//            reactivarlo se toma la posicin actual de su esqueleto.
+//
+void CACrowd::setEnabled(int agent, bool enabled)
+{
+	CAAgent& a = agents[agent];
+	if (enabled && !a.enabled)
+	{
+		glm::mat4 location = a.skeleton->getLocation();
+		a.position = glm::vec2(location[3].x, location[3].z);
+		a.height = location[3].y;
+	}
+	a.enabled = enabled;
+	a.velocity = glm::vec2(0.0f, 0.0f);
+}
+
+//
+// FUNCIN: CACrowd::setMaxSpeed(float speed)
+//
+// PROPSITO: Asigna la velocidad mxima de los agentes (metros por segundo)
+//
+void CACrowd::setMaxSpeed(float speed)
+{
+	this->maxSpeed = speed;
+}
+
+//
+// FUNCIN: CACrowd::setTimeScale(float scale)
+//
+// PROPSITO: Asigna la escala de tiempo de la simulacin (0 la detiene)
+//
+void CACrowd::setTimeScale(float scale)
+{
+	this->timeScale = scale;
+}
+
+//
+// FUNCIN: CACrowd::setClipTime(float time)
+//
+// PROPSITO: Sita la animacin de todos los agentes en el instante indicado
+//
+void CACrowd::setClipTime(float time)
+{
+	for (size_t i = 0; i < agents.size(); i++)
+	{
+		agents[i].clipTime = time;
+	}
+}
+
+//
+// FUNCIN: CACrowd::setProceduralGait(bool procedural)
+//
+// PROPSITO: Elige entre el generador procedural (CAGait) y el clip con keyframes
+//
+void CACrowd::setProceduralGait(bool procedural)
+{
+	this->procedural = procedural;
+}
+
+//
+// FUNCIN: CACrowd::isProceduralGait()
+//
+// PROPSITO: Indica si los agentes usan el generador procedural
+//
+bool CACrowd::isProceduralGait()
+{
+	return procedural;
+}
+
+//
+// FUNCIN: CACrowd::getAgents()
+//
+// PROPSITO: Obtiene el estado de los agentes
+//
+const std::vector<CAAgent>& CACrowd::getAgents()
+{
+	return agents;
+}
+
+//
+// FUNCIN: CACrowd::step(float dt)
+//
+// PROPSITO: Avanza la simulacin: reconstruye la tabla hash, calcula el guiado de
+//            cada celda en paralelo y despus mueve y anima cada agente en paralelo
+//
+void CACrowd::step(float dt)
+{
+	// Se limita el paso para que una pausa larga (p.ej. al cargar) no lance a los agentes
+	dt = std::min(dt, CROWD_MAX_STEP) * timeScale;
+	if (dt <= 0.0f || agents.empty()) return;
+
+	buildHash();
+
+	jobs->parallelFor(occupiedCells.size(), [this, dt](size_t index, uint32_t worker) {
+		steerCell(occupiedCells[index], dt);
+	});
+
+	jobs->parallelFor(agents.size(), [this, dt](size_t index, uint32_t worker) {
+		moveAgent((uint32_t)index, dt);
+	});
+}
+
+//
+// FUNCIN: CACrowd::hashCell(int cx, int cz)
+//
+// PROPSITO: ndice en la tabla de la celda (cx, cz)
+//
+uint32_t CACrowd::hashCell(int cx, int cz)
+{
+	uint32_t h = ((uint32_t)cx * 73856093u) ^ ((uint32_t)cz * 19349663u);
+	return h & tableMask;
+}
+
+//
+// FUNCIN: CACrowd::buildHash()
+//
+// PROPSITO: Reconstruye la tabla hash espacial con una ordenacin por recuento
+//
+void CACrowd::buildHash()
+{
+	uint32_t tableSize = 1;
+	while (tableSize < 2 * agents.size()) tableSize <<= 1;
+	tableMask = tableSize - 1;
+
+	agentCell.resize(agents.size());
+	cellAgents.resize(agents.size());
+	cellStart.assign(tableSize + 1, 0);
+	occupiedCells.clear();
+
+	for (size_t i = 0; i < agents.size(); i++)
+	{
+		int cx = (int)floor(agents[i].position.x / cellSize);
+		int cz = (int)floor(agents[i].position.y / cellSize);
+		agentCell[i] = hashCell(cx, cz);
+		cellStart[agentCell[i] + 1]++;
+	}
+
+	for (uint32_t h = 0; h < tableSize; h++)
+	{
+		if (cellStart[h + 1] > 0) occupiedCells.push_back(h);
+		cellStart[h + 1] += cellStart[h];
+	}
+
+	std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+	for (size_t i = 0; i < agents.size(); i++)
+	{
+		cellAgents[fill[agentCell[i]]++] = (uint32_t)i;
+	}
+}
+
+//
+// FUNCIN: CACrowd::steerCell(uint32_t cell, float dt)
+//
+// PROPSITO: Calcula el guiado de los agentes de una entrada de la tabla
+//
+void CACrowd::steerCell(uint32_t cell, float dt)
+{
+	for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; i++)
+	{
+		steerAgent(cellAgents[i], dt);
+	}
+}
+
+//
+// FUNCIN: CACrowd::steerAgent(uint32_t agent, float dt)
+//
+// PROPSITO: Combina separacin, alineamiento y bsqueda del objetivo consultando
+//            solo las 3x3 celdas que rodean al agente. El resultado se guarda en
+//            steering para no modificar el estado que leen los dems hilos.
+//
+void CACrowd::steerAgent(uint32_t agent, float dt)
+{
+	const CAAgent& a = agents[agent];
+	if (!a.enabled)
+	{
+		steering[agent] = glm::vec2(0.0f, 0.0f);
+		return;
+	}
+
+	int cx = (int)floor(a.position.x / cellSize);
+	int cz = (int)floor(a.position.y / cellSize);
+
+	glm::vec2 separation = glm::vec2(0.0f, 0.0f);
+	glm::vec2 alignment = glm::vec2(0.0f, 0.0f);
+	int neighbours = 0;
+
+	// Dos celdas pueden compartir entrada en la tabla; cada entrada se visita una vez
+	uint32_t visited[9];
+	int visitedCount = 0;
+
+	for (int dz = -1; dz <= 1; dz++)
+	{
+		for (int dx = -1; dx <= 1; dx++)
+		{
+			uint32_t h = hashCell(cx + dx, cz + dz);
+			bool seen = false;
+			for (int v = 0; v < visitedCount; v++) seen = seen || (visited[v] == h);
+			if (seen) continue;
+			visited[visitedCount++] = h;
+
+			for (uint32_t k = cellStart[h]; k < cellStart[h + 1]; k++)
+			{
+				uint32_t other = cellAgents[k];
+				if (other == agent) continue;
+
+				glm::vec2 offset = a.position - agents[other].position;
+				float d2 = glm::dot(offset, offset);
+				if (d2 > cellSize * cellSize || d2 < 1e-8f) continue;
+
+				if (d2 < CROWD_SEPARATION_RADIUS * CROWD_SEPARATION_RADIUS)
+				{
+					separation = separation + offset / d2;
+				}
+				alignment = alignment + agents[other].velocity;
+				neighbours++;
+			}
+		}
+	}
+
+	glm::vec2 force = glm::vec2(0.0f, 0.0f);
+
+	float agentSpeed = maxSpeed * a.speedFactor;
+	glm::vec2 toGoal = a.goal - a.position;
+	float goalDistance = glm::length(toGoal);
+	if (goalDistance > 1e-4f)
+	{
+		glm::vec2 desired = toGoal * (agentSpeed / goalDistance);
+		force = force + (desired - a.velocity) * CROWD_GOAL_WEIGHT;
+	}
+
+	force = force + separation * CROWD_SEPARATION_WEIGHT;
+
+	if (neighbours > 0)
+	{
+		alignment = alignment / (float)neighbours;
+		force = force + (alignment - a.velocity) * CROWD_ALIGNMENT_WEIGHT;
+	}
+
+	glm::vec2 velocity = a.velocity + force * dt;
+	float speed = glm::length(velocity);
+	if (speed > agentSpeed) velocity = velocity * (agentSpeed / speed);
+	steering[agent] = velocity;
+}
+
+//
+// FUNCIN: CACrowd::moveAgent(uint32_t agent, float dt)
+//
+// PROPSITO: Integra la posicin, orienta el esqueleto segn la velocidad y avanza
+//            la animacin (clip o generador procedural) en proporcin a la distancia
+//            recorrida
+//
+void CACrowd::moveAgent(uint32_t agent, float dt)
+{
+	CAAgent& a = agents[agent];
+	if (!a.enabled) return;
+
+	a.velocity = steering[agent];
+	a.position = a.position + a.velocity * dt;
+	a.position.x = glm::clamp(a.position.x, -groundWidth, groundWidth);
+	a.position.y = glm::clamp(a.position.y, -groundDepth, groundDepth);
+
+	if (glm::length(a.goal - a.position) < CROWD_GOAL_RADIUS)
+	{
+		a.goal = randomGoal(a.seed);
+	}
+
+	float speed = glm::length(a.velocity);
+	if (speed > 1e-3f)
+	{
+		glm::vec2 target = a.velocity / speed;
+		a.heading = glm::normalize(a.heading + (target - a.heading) * CROWD_TURN_SPEED);
+	}
+
+	glm::vec3 dir = glm::vec3(a.heading.x, 0.0f, a.heading.y);
+	glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::vec3 right = glm::cross(up, dir);
+	glm::vec3 offset = glm::vec3(a.position.x, a.height, a.position.y);
+	a.skeleton->setLocation(glm::mat4(glm::vec4(right, 0.0f), glm::vec4(up, 0.0f), glm::vec4(dir, 0.0f), glm::vec4(offset, 1.0f)));
+
+	if (procedural && a.gait != nullptr)
+	{
+		a.gait->update(speed, dt);
+		return;
+	}
+
+	float clipLength = a.animation->getLength();
+	a.clipTime += speed * dt * CROWD_CLIP_PER_METRE;
+	if (clipLength > 0.0f) a.clipTime = fmod(a.clipTime, clipLength);
+	a.animation->animation(a.clipTime);
+}
+
+//
+// FUNCIN: CACrowd::randomGoal(uint32_t& seed)
+//
+// PROPSITO: Genera un objetivo aleatorio dentro del suelo (generador por agente para
+//            que los hilos no compartan estado)
+//
+glm::vec2 CACrowd::randomGoal(uint32_t& seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+	float u = (float)(seed >> 8) / 16777216.0f;
+	seed = seed * 1664525u + 1013904223u;
+	float v = (float)(seed >> 8) / 16777216.0f;
+
+	float w = groundWidth - CROWD_GOAL_MARGIN;
+	float d = groundDepth - CROWD_GOAL_MARGIN;
+	return glm::vec2((2.0f * u - 1.0f) * w, (2.0f * v - 1.0f) * d);
+}
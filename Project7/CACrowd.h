@@ -0,0 +1,83 @@
+#pragma once
+
+#include "CASkeleton.h"
+#include "Animation.h"
+#include "CAGait.h"
+#include "CAJobSystem.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+//
+// ESTRUCTURA: CAAgent
+//
+// DESCRIPCIN: Personaje de la multitud. La posicin y la velocidad estn en el plano
+//              del suelo (x, z). clipTime es el instante de la animacin de andar y
+//              speedFactor escala la velocidad mxima para que no anden todos igual.
+//
+struct CAAgent {
+	glm::vec2 position;
+	glm::vec2 velocity;
+	glm::vec2 heading;
+	glm::vec2 goal;
+	float height;
+	float clipTime;
+	float speedFactor;
+	uint32_t seed;
+	bool enabled;
+	CASkeleton* skeleton;
+	Animation* animation;
+	CAGait* gait;
+};
+
+//
+// CLASE: CACrowd
+//
+// DESCRIPCIN: Simulacin de una multitud sobre el plano del suelo con tres reglas de
+//              guiado: separacin, alineamiento y bsqueda del objetivo. Los vecinos se
+//              buscan en una tabla hash espacial uniforme que se reconstruye en cada
+//              paso, y la actualizacin se reparte por celdas entre los hilos.
+//              La velocidad de la raz marca el ritmo de la animacin de andar.
+//
+class CACrowd
+{
+public:
+	CACrowd(CAJobSystem* jobs, float groundWidth, float groundDepth, float cellSize);
+	~CACrowd();
+	int addAgent(CASkeleton* skeleton, Animation* animation, CAGait* gait, glm::vec2 position, glm::vec2 heading);
+	void removeAgent(CASkeleton* skeleton);
+	void setEnabled(int agent, bool enabled);
+	void setMaxSpeed(float speed);
+	void setTimeScale(float scale);
+	void setClipTime(float time);
+	void setProceduralGait(bool procedural);
+	bool isProceduralGait();
+	void step(float dt);
+	const std::vector<CAAgent>& getAgents();
+
+private:
+	CAJobSystem* jobs;
+	float groundWidth;
+	float groundDepth;
+	float cellSize;
+	float maxSpeed;
+	float timeScale;
+	bool procedural;
+
+	std::vector<CAAgent> agents;
+	std::vector<glm::vec2> steering;
+
+	// Tabla hash espacial: cellStart[h]..cellStart[h+1] indexa cellAgents
+	uint32_t tableMask;
+	std::vector<uint32_t> agentCell;
+	std::vector<uint32_t> cellStart;
+	std::vector<uint32_t> cellAgents;
+	std::vector<uint32_t> occupiedCells;
+
+	uint32_t hashCell(int cx, int cz);
+	void buildHash();
+	void steerCell(uint32_t cell, float dt);
+	void steerAgent(uint32_t agent, float dt);
+	void moveAgent(uint32_t agent, float dt);
+	glm::vec2 randomGoal(uint32_t& seed);
+};
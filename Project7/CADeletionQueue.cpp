@@ -0,0 +1,73 @@
+#include "CADeletionQueue.h"
+
+//
+// FUNCIN: CADeletionQueue::CADeletionQueue()
+//
+// PROPSITO: Crea la cola vaca
+//
+CADeletionQueue::CADeletionQueue()
+{
+}
+
+//
+// FUNCIN: CADeletionQueue::~CADeletionQueue()
+//
+// PROPSITO: Destruye la cola. Las entradas pendientes deben vaciarse antes con flush()
+//            mientras el dispositivo sigue existiendo.
+//
+CADeletionQueue::~CADeletionQueue()
+{
+}
+
+//
+// FUNCIN: CADeletionQueue::push(uint64_t value, const std::function<void()>& destroy)
+//
+// PROPSITO: Aade una destruccin que se ejecutar cuando el timeline alcance value.
+//            Los valores crecen con cada envo, as que la cola queda ordenada.
+//
+void CADeletionQueue::push(uint64_t value, const std::function<void()>& destroy)
+{
+	Entry entry;
+	entry.value = value;
+	entry.destroy = destroy;
+	entries.push_back(entry);
+}
+
+//
+// FUNCIN: CADeletionQueue::collect(uint64_t completedValue)
+//
+// PROPSITO: Ejecuta las destrucciones de los envos ya terminados en la GPU
+//
+void CADeletionQueue::collect(uint64_t completedValue)
+{
+	while (!entries.empty() && entries.front().value <= completedValue)
+	{
+		entries.front().destroy();
+		entries.pop_front();
+	}
+}
+
+//
+// FUNCIN: CADeletionQueue::flush()
+//
+// PROPSITO: Ejecuta todas las destrucciones pendientes. Slo debe llamarse con el
+//            dispositivo inactivo.
+//
+void CADeletionQueue::flush()
+{
+	while (!entries.empty())
+	{
+		entries.front().destroy();
+		entries.pop_front();
+	}
+}
+
+//
+// FUNCIN: CADeletionQueue::getPendingCount()
+//
+// PROPSITO: Obtiene el nmero de destrucciones pendientes
+//
+size_t CADeletionQueue::getPendingCount()
+{
+	return entries.size();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+//
+// CLASE: CADeletionQueue
+//
+// DESCRIPCIN: Cola de destruccin diferida de objetos de Vulkan. Cada entrada guarda
+//              el valor del timeline del ltimo envo que puede usar el objeto y se
+//              ejecuta cuando la GPU lo ha alcanzado, sin esperar a que el
+//              dispositivo quede libre.
+//
+class CADeletionQueue
+{
+public:
+	CADeletionQueue();
+	~CADeletionQueue();
+	void push(uint64_t value, const std::function<void()>& destroy);
+	void collect(uint64_t completedValue);
+	void flush();
+	size_t getPendingCount();
+
+private:
+	struct Entry {
+		uint64_t value;
+		std::function<void()> destroy;
+	};
+
+	std::deque<Entry> entries;
+};
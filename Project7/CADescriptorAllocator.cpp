@@ -0,0 +1,171 @@
+#include "CADescriptorAllocator.h"
+#include <algorithm>
+#include <stdexcept>
+
+// Capacidad mxima de un pool y descriptores de cada tipo reservados por set
+#define DESCRIPTOR_MAX_SETS_PER_POOL 4096
+
+static const VkDescriptorPoolSize descriptorRatios[] = {
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 3 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 }
+};
+
+//
+// FUNCIN: CADescriptorAllocator::CADescriptorAllocator(VkDevice device, bool freeable, uint32_t setsPerPool)
+//
+// PROPSITO: Crea el asignador. Con freeable los sets pueden liberarse uno a uno;
+//            si no, slo se liberan todos juntos con reset().
+//
+CADescriptorAllocator::CADescriptorAllocator(VkDevice device, bool freeable, uint32_t setsPerPool)
+{
+	this->device = device;
+	this->freeable = freeable;
+	this->setsPerPool = setsPerPool;
+	this->currentPool = VK_NULL_HANDLE;
+}
+
+//
+// FUNCIN: CADescriptorAllocator::~CADescriptorAllocator()
+//
+// PROPSITO: Destruye todos los pools (y con ellos sus sets)
+//
+CADescriptorAllocator::~CADescriptorAllocator()
+{
+	for (size_t i = 0; i < usedPools.size(); i++)
+	{
+		vkDestroyDescriptorPool(device, usedPools[i], nullptr);
+	}
+	for (size_t i = 0; i < freePools.size(); i++)
+	{
+		vkDestroyDescriptorPool(device, freePools[i], nullptr);
+	}
+}
+
+//
+// FUNCIN: CADescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+//
+// PROPSITO: Reserva un descriptor set. Si el pool actual est agotado o
+//            fragmentado se pasa al siguiente y se reintenta una vez.
+//
+VkDescriptorSet CADescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+{
+	if (currentPool == VK_NULL_HANDLE) nextPool();
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = currentPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+
+	VkDescriptorSet set;
+	VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+	{
+		nextPool();
+		allocInfo.descriptorPool = currentPool;
+		result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+	}
+
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate descriptor sets!");
+	}
+
+	if (freeable) owners[set] = currentPool;
+	return set;
+}
+
+//
+// FUNCIN: CADescriptorAllocator::free(VkDescriptorSet set)
+//
+// PROPSITO: Devuelve un descriptor set a su pool (slo en asignadores freeable)
+//
+void CADescriptorAllocator::free(VkDescriptorSet set)
+{
+	std::map<VkDescriptorSet, VkDescriptorPool>::iterator it = owners.find(set);
+	if (it == owners.end()) return;
+
+	vkFreeDescriptorSets(device, it->second, 1, &set);
+	owners.erase(it);
+}
+
+//
+// FUNCIN: CADescriptorAllocator::reset()
+//
+// PROPSITO: Libera todos los sets reiniciando cada pool con una sola llamada.
+//            Los pools se conservan para reutilizarlos.
+//
+void CADescriptorAllocator::reset()
+{
+	for (size_t i = 0; i < usedPools.size(); i++)
+	{
+		vkResetDescriptorPool(device, usedPools[i], 0);
+		freePools.push_back(usedPools[i]);
+	}
+	usedPools.clear();
+	owners.clear();
+	currentPool = VK_NULL_HANDLE;
+}
+
+//
+// FUNCIN: CADescriptorAllocator::getPoolCount()
+//
+// PROPSITO: Obtiene el nmero de pools creados
+//
+uint32_t CADescriptorAllocator::getPoolCount()
+{
+	return (uint32_t)(usedPools.size() + freePools.size());
+}
+
+//
+// FUNCIN: CADescriptorAllocator::createPool(uint32_t maxSets)
+//
+// PROPSITO: Crea un pool con capacidad para maxSets sets de composicin variada
+//
+VkDescriptorPool CADescriptorAllocator::createPool(uint32_t maxSets)
+{
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	for (size_t i = 0; i < sizeof(descriptorRatios) / sizeof(descriptorRatios[0]); i++)
+	{
+		VkDescriptorPoolSize poolSize = descriptorRatios[i];
+		poolSize.descriptorCount *= maxSets;
+		poolSizes.push_back(poolSize);
+	}
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = freeable ? VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT : 0;
+	poolInfo.poolSizeCount = (uint32_t)poolSizes.size();
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = maxSets;
+
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create descriptor pool!");
+	}
+	return pool;
+}
+
+//
+// FUNCIN: CADescriptorAllocator::nextPool()
+//
+// PROPSITO: Pasa a un pool reutilizado o, si no queda ninguno, a uno nuevo con
+//            el doble de capacidad que el anterior
+//
+void CADescriptorAllocator::nextPool()
+{
+	if (!freePools.empty())
+	{
+		currentPool = freePools.back();
+		freePools.pop_back();
+	}
+	else
+	{
+		currentPool = createPool(setsPerPool);
+		setsPerPool = std::min(setsPerPool * 2, (uint32_t)DESCRIPTOR_MAX_SETS_PER_POOL);
+	}
+	usedPools.push_back(currentPool);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+//
+// CLASE: CADescriptorAllocator
+//
+// DESCRIPCIN: Reparte descriptor sets desde pools compartidos. Cuando un pool se
+//              agota se crea otro con el doble de capacidad, de modo que el nmero
+//              de pools crece de forma logartmica con el de objetos. Puede usarse
+//              como asignador global (los sets se liberan uno a uno) o como
+//              asignador por fotograma (todos los pools se reinician de una vez).
+//
+class CADescriptorAllocator
+{
+public:
+	CADescriptorAllocator(VkDevice device, bool freeable, uint32_t setsPerPool = 32);
+	~CADescriptorAllocator();
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+	void free(VkDescriptorSet set);
+	void reset();
+	uint32_t getPoolCount();
+
+private:
+	VkDevice device;
+	bool freeable;
+	uint32_t setsPerPool;
+	std::vector<VkDescriptorPool> usedPools;
+	std::vector<VkDescriptorPool> freePools;
+	VkDescriptorPool currentPool;
+	std::map<VkDescriptorSet, VkDescriptorPool> owners;
+
+	VkDescriptorPool createPool(uint32_t maxSets);
+	void nextPool();
+};
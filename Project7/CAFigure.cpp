@@ -1,6 +1,5 @@
 #include "CAFigure.h"
 #include "CAVertex.h"
-#include "CATransform.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
@@ -8,98 +7,73 @@
 //
 // FUNCIN: CAFigure::initialize(CAVulkanState* vulkan)
 //
-// PROPSITO: Crea el Vertex Buffer
+// PROPSITO: Aade la geometra de la figura a los buffers comunes y registra su material
 //
 void CAFigure::initialize(CAVulkanState* vulkan)
 {
 	location = glm::mat4(1.0f);
+	mesh = vulkan->createMesh(vertices, indices);
 
-	size_t vertexSize = sizeof(CAVertex) * vertices.size();
-	vulkan->createVertexBuffer(vertexSize, vertices.data(), &vbo);
-
-	size_t indexSize = sizeof(indices[0]) * indices.size();
-	vulkan->createIndexBuffer(indexSize, indices.data(), &ibo);
-
-	size_t transformBufferSize = sizeof(CATransform);
-	vulkan->createUniformBuffer(transformBufferSize, &transformBuffer);
-
-	size_t lightBufferSize = sizeof(CALight);
-	vulkan->createUniformBuffer(lightBufferSize, &lightBuffer);
-
-	size_t materialBufferSize = sizeof(CAMaterial);
-	vulkan->createUniformBuffer(materialBufferSize, &materialBuffer);
-
-
-	CAUniformBuffer* buffers[] = { &transformBuffer, &lightBuffer, &materialBuffer };
-	size_t sizes[] = { transformBufferSize, lightBufferSize, materialBufferSize };
-
-	vulkan->createDescriptorSets(&descriptorPool, &descriptorSets, buffers, sizes, 3);
+	material = {};
+	materialIndex = vulkan->registerMaterial(material);
 }
 
 //
-// FUNCIN: CAFigure::finalize(VkDevice device)
+// FUNCIN: CAFigure::addDraws(CAVulkanState* vulkan)
 //
-// PROPSITO: Libera los buffers de la figura
+// PROPSITO: Aade la figura a la lista de dibujo del fotograma con su posicin y
+//            su material
 //
-void CAFigure::finalize(CAVulkanState* vulkan)
+void CAFigure::addDraws(CAVulkanState* vulkan)
 {
-	vulkan->destroyVertexBuffer(vbo);
-	vulkan->destroyIndexBuffer(ibo);
-	vulkan->destroyUniformBuffer(transformBuffer);
-	vulkan->destroyUniformBuffer(lightBuffer);
-	vulkan->destroyUniformBuffer(materialBuffer);
-	vulkan->destroyDescriptorSets(descriptorPool, descriptorSets);
+	CAInstance instance;
+	instance.ModelMatrix = location;
+	instance.MaterialIndex = materialIndex;
+	instance.PaletteBase = -1;
+
+	vulkan->addDraw(mesh, &instance, 1);
 }
 
 //
-// FUNCIN: CAFigure::addCommands(CAVulkanState* vulkan, VkCommandBuffer commandBuffer, int index)
+// FUNCIN: CAFigure::getMesh()
 //
-// PROPSITO: Aade los comandos de renderizado al command buffer
+// PROPSITO: Obtiene la posicin de la geometra de la figura en los buffers comunes
 //
-void CAFigure::addCommands(CAVulkanState* vulkan, VkCommandBuffer commandBuffer, int index)
+CAMesh CAFigure::getMesh()
 {
-	VkDeviceSize offset = 0;
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vbo.buffer, &offset);
-	vkCmdBindIndexBuffer(commandBuffer, ibo.buffer, 0, VK_INDEX_TYPE_UINT16);
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan->getPipelineLayout(), 0, 1, &descriptorSets[index], 0, nullptr);
-	vkCmdDrawIndexed(commandBuffer, (uint32_t)indices.size(), 1, 0, 0, 0);
+	return mesh;
 }
 
 //
-// FUNCIN: CAFigure::updateUniformBuffers(CAVulkanState* vulkan, glm::mat4 view, glm::mat4 projection)
+// FUNCIN: CAFigure::getVertices()
 //
-// PROPSITO: Actualiza las variables uniformes sobre una imagen del swapchain
+// PROPSITO: Obtiene la copia en el host de los vrtices de la figura
 //
-void CAFigure::updateUniformBuffers(CAVulkanState* vulkan, glm::mat4 view, glm::mat4 projection)
+const std::vector<CAVertex>& CAFigure::getVertices()
 {
-	CATransform transform;
-	transform.MVP = projection * view * location;
-	transform.ModelViewMatrix = view * location;
-	transform.ViewMatrix = view;
-
-	vulkan->updateUniformBuffer(sizeof(CATransform), &transform, transformBuffer);
-	vulkan->updateUniformBuffer(sizeof(CALight), &light, lightBuffer);
-	vulkan->updateUniformBuffer(sizeof(CAMaterial), &material, materialBuffer);
+	return vertices;
 }
 
 //
-// FUNCIN: CAFigure::setLight(CALight l)
+// FUNCIN: CAFigure::getIndices()
 //
-// PROPSITO: Asigna las propiedades de la luz que incide en la figura
+// PROPSITO: Obtiene la copia en el host de los ndices de la figura
 //
-void CAFigure::setLight(CALight l)
+const std::vector<uint16_t>& CAFigure::getIndices()
 {
-	this->light = l;
+	return indices;
 }
 
 //
-// FUNCIN: CAFigure::setMaterial(CAMaterial m)
+// FUNCIN: CAFigure::setMaterial(CAVulkanState* vulkan, CAMaterial m)
 //
-// PROPSITO: Asigna las propiedades del material del que est formada la figura
+// PROPSITO: Asigna las propiedades del material del que est formada la figura.
+//            El material se guarda en la tabla comn y la figura slo usa su ndice.
 //
-void CAFigure::setMaterial(CAMaterial m)
+void CAFigure::setMaterial(CAVulkanState* vulkan, CAMaterial m)
 {
 	this->material = m;
+	this->materialIndex = vulkan->registerMaterial(m);
 }
 
 //
@@ -0,0 +1,143 @@
+#include "CAGait.h"
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// Velocidad (m/s) a la que se usa la zancada nominal; a otras velocidades se escala
+#define GAIT_REFERENCE_SPEED 1.2f
+#define GAIT_MIN_STRIDE 0.3f
+#define GAIT_MAX_STRIDE 1.3f
+// Por debajo de esta velocidad la amplitud se reduce hasta la pose de reposo
+#define GAIT_STOP_SPEED 0.2f
+// Flexin mxima de la rodilla respecto al giro de la cadera, y flexin en apoyo
+#define GAIT_KNEE_GAIN 2.5f
+#define GAIT_STANCE_KNEE 5.0f
+
+//
+// FUNCIN: CAGait::CAGait(CASkeleton* skeleton, float strideLength)
+//
+// PROPSITO: Construye el generador. strideLength es la distancia que avanza el
+//            personaje en un ciclo completo (dos pasos) a la velocidad de referencia.
+//
+CAGait::CAGait(CASkeleton* skeleton, float strideLength)
+{
+	this->skeleton = skeleton;
+	this->strideLength = strideLength;
+	this->phase = 0.0f;
+
+	legL = nullptr;
+	legR = nullptr;
+	kneeL = nullptr;
+	kneeR = nullptr;
+
+	std::vector<CABalljoint*> roots = skeleton->getHijas();
+	for (size_t i = 0; i < roots.size(); i++)
+	{
+		if (legL == nullptr) legL = findJoint(roots[i], "leg_l");
+		if (legR == nullptr) legR = findJoint(roots[i], "leg_r");
+		if (kneeL == nullptr) kneeL = findJoint(roots[i], "knee_l");
+		if (kneeR == nullptr) kneeR = findJoint(roots[i], "knee_r");
+	}
+
+	if (legL == nullptr || legR == nullptr || kneeL == nullptr || kneeR == nullptr)
+	{
+		throw std::runtime_error("failed to find leg joints for gait!");
+	}
+
+	legLength = legL->getLength() + kneeL->getLength();
+}
+
+//
+// FUNCIN: CAGait::~CAGait()
+//
+// PROPSITO: Destruye el generador (el esqueleto no es de su propiedad)
+//
+CAGait::~CAGait()
+{
+}
+
+//
+// FUNCIN: CAGait::findJoint(CABalljoint* joint, std::string name)
+//
+// PROPSITO: Busca una articulacin por nombre en el subrbol de joint
+//
+CABalljoint* CAGait::findJoint(CABalljoint* joint, std::string name)
+{
+	if (joint->getName() == name) return joint;
+
+	std::vector<CABalljoint*> hijas = joint->getHijas();
+	for (size_t i = 0; i < hijas.size(); i++)
+	{
+		CABalljoint* found = findJoint(hijas[i], name);
+		if (found != nullptr) return found;
+	}
+	return nullptr;
+}
+
+//
+// FUNCIN: CAGait::update(float speed, float dt)
+//
+// PROPSITO: Avanza la fase segn la distancia recorrida y aplica la pose
+//
+void CAGait::update(float speed, float dt)
+{
+	float stride = strideLength * glm::clamp(speed / GAIT_REFERENCE_SPEED, GAIT_MIN_STRIDE, GAIT_MAX_STRIDE);
+	phase += speed * dt / stride;
+	phase -= floor(phase);
+	pose(speed, phase);
+}
+
+//
+// FUNCIN: CAGait::pose(float speed, float phase)
+//
+// PROPSITO: Calcula la pose de las piernas. La cadera oscila con amplitud tal que la
+//            longitud de paso (media zancada) sea 2 * legLength * sin(A); la rodilla se
+//            flexiona durante el balanceo, cuando la pierna avanza. Las dos piernas
+//            van en oposicin de fase.
+//
+void CAGait::pose(float speed, float phase)
+{
+	float stride = strideLength * glm::clamp(speed / GAIT_REFERENCE_SPEED, GAIT_MIN_STRIDE, GAIT_MAX_STRIDE);
+	float amplitude = glm::degrees((float)asin(std::min(stride / (4.0f * legLength), 0.95f)));
+	amplitude *= std::min(speed / GAIT_STOP_SPEED, 1.0f);
+
+	float left = glm::two_pi<float>() * phase;
+	float right = left + glm::pi<float>();
+
+	// Un ngulo X negativo adelanta la pierna y uno positivo flexiona la rodilla
+	legL->setPose(-amplitude * (float)sin(left), 0.0f, 0.0f);
+	legR->setPose(-amplitude * (float)sin(right), 0.0f, 0.0f);
+	kneeL->setPose(GAIT_STANCE_KNEE + GAIT_KNEE_GAIN * amplitude * std::max(0.0f, (float)cos(left)), 0.0f, 0.0f);
+	kneeR->setPose(GAIT_STANCE_KNEE + GAIT_KNEE_GAIN * amplitude * std::max(0.0f, (float)cos(right)), 0.0f, 0.0f);
+}
+
+//
+// FUNCIN: CAGait::setPhase(float phase)
+//
+// PROPSITO: Asigna la fase del ciclo (0..1)
+//
+void CAGait::setPhase(float phase)
+{
+	this->phase = phase - floor(phase);
+}
+
+//
+// FUNCIN: CAGait::getPhase()
+//
+// PROPSITO: Obtiene la fase del ciclo (0..1)
+//
+float CAGait::getPhase()
+{
+	return phase;
+}
+
+//
+// FUNCIN: CAGait::setStrideLength(float strideLength)
+//
+// PROPSITO: Asigna la longitud de zancada a la velocidad de referencia
+//
+void CAGait::setStrideLength(float strideLength)
+{
+	this->strideLength = strideLength;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "CASkeleton.h"
+
+//
+// CLASE: CAGait
+//
+// DESCRIPCIN: Generador procedural del ciclo de andar. Calcula la pose de leg_l,
+//              leg_r, knee_l y knee_r de forma analtica a partir de la velocidad,
+//              la longitud de zancada y la fase del ciclo, sin guardar keyframes.
+//
+class CAGait
+{
+public:
+	CAGait(CASkeleton* skeleton, float strideLength);
+	~CAGait();
+	void update(float speed, float dt);
+	void pose(float speed, float phase);
+	void setPhase(float phase);
+	float getPhase();
+	void setStrideLength(float strideLength);
+
+private:
+	CASkeleton* skeleton;
+	CABalljoint* legL;
+	CABalljoint* legR;
+	CABalljoint* kneeL;
+	CABalljoint* kneeR;
+	float strideLength;
+	float legLength;
+	float phase;
+
+	CABalljoint* findJoint(CABalljoint* joint, std::string name);
+};
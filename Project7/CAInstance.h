@@ -0,0 +1,11 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+
+typedef struct
+{
+	alignas(16) glm::mat4 ModelMatrix;
+	alignas(4) uint32_t MaterialIndex;
+	alignas(4) int32_t PaletteBase;     // Primera matriz de la paleta, o -1 si no usa paleta
+} CAInstance;
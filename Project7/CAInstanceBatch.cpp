@@ -0,0 +1,86 @@
+#include "CAInstanceBatch.h"
+
+//
+// FUNCIN: CAInstanceBatch::CAInstanceBatch(CAFigure* mesh)
+//
+// PROPSITO: Construye el lote. La figura pasa a ser propiedad del lote.
+//
+CAInstanceBatch::CAInstanceBatch(CAFigure* mesh)
+{
+	this->mesh = mesh;
+}
+
+//
+// FUNCIN: CAInstanceBatch::~CAInstanceBatch()
+//
+// PROPSITO: Destruye el lote y su figura
+//
+CAInstanceBatch::~CAInstanceBatch()
+{
+	delete mesh;
+}
+
+//
+// FUNCIN: CAInstanceBatch::initialize(CAVulkanState* vulkan)
+//
+// PROPSITO: Aade la geometra de la figura a los buffers comunes
+//
+void CAInstanceBatch::initialize(CAVulkanState* vulkan)
+{
+	mesh->initialize(vulkan);
+}
+
+//
+// FUNCIN: CAInstanceBatch::addDraws(CAVulkanState* vulkan)
+//
+// PROPSITO: Aade todas las instancias a la lista de dibujo del fotograma
+//
+void CAInstanceBatch::addDraws(CAVulkanState* vulkan)
+{
+	vulkan->addDraw(mesh->getMesh(), instances.data(), (uint32_t)instances.size());
+}
+
+//
+// FUNCIN: CAInstanceBatch::clear()
+//
+// PROPSITO: Vaca la lista de instancias del fotograma
+//
+void CAInstanceBatch::clear()
+{
+	instances.clear();
+}
+
+//
+// FUNCIN: CAInstanceBatch::addInstance(const glm::mat4& matrix, uint32_t materialIndex)
+//
+// PROPSITO: Aade una instancia con su matriz de localizacin (Model) y el ndice de
+//            su material en la tabla comn
+//
+void CAInstanceBatch::addInstance(const glm::mat4& matrix, uint32_t materialIndex)
+{
+	CAInstance instance;
+	instance.ModelMatrix = matrix;
+	instance.MaterialIndex = materialIndex;
+	instance.PaletteBase = -1;
+	instances.push_back(instance);
+}
+
+//
+// FUNCIN: CAInstanceBatch::getInstanceCount()
+//
+// PROPSITO: Obtiene el nmero de instancias del fotograma
+//
+uint32_t CAInstanceBatch::getInstanceCount()
+{
+	return (uint32_t)instances.size();
+}
+
+//
+// FUNCIN: CAInstanceBatch::getFigure()
+//
+// PROPSITO: Obtiene la figura que se dibuja en cada instancia
+//
+CAFigure* CAInstanceBatch::getFigure()
+{
+	return mesh;
+}
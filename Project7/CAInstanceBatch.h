@@ -0,0 +1,32 @@
+#pragma once
+
+#include "CAVulkanState.h"
+#include "CAFigure.h"
+#include "CAInstance.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+//
+// CLASE: CAInstanceBatch
+//
+// DESCRIPCIN: Conjunto de instancias de una misma figura que ocupan un nico dibujo
+//              de la lista del fotograma. La matriz y el material de cada instancia van
+//              al storage buffer de instancias, que el vertex shader lee con
+//              gl_InstanceIndex.
+//
+class CAInstanceBatch
+{
+public:
+	CAInstanceBatch(CAFigure* mesh);
+	~CAInstanceBatch();
+	void initialize(CAVulkanState* vulkan);
+	void addDraws(CAVulkanState* vulkan);
+	void clear();
+	void addInstance(const glm::mat4& matrix, uint32_t materialIndex);
+	uint32_t getInstanceCount();
+	CAFigure* getFigure();
+
+private:
+	CAFigure* mesh;
+	std::vector<CAInstance> instances;
+};
@@ -0,0 +1,136 @@
+#include "CAJobSystem.h"
+
+//
+// FUNCIN: CAJobSystem::CAJobSystem(uint32_t threads)
+//
+// PROPSITO: Crea los hilos de trabajo. Con threads = 0 se usa un hilo por
+//            ncleo disponible, descontando el hilo principal.
+//
+CAJobSystem::CAJobSystem(uint32_t threads)
+{
+	nextJob = 0;
+	pendingJobs = 0;
+
+	if (threads == 0)
+	{
+		uint32_t cores = std::thread::hardware_concurrency();
+		threads = (cores > 1) ? cores - 1 : 0;
+	}
+
+	for (uint32_t i = 0; i < threads; i++)
+	{
+		workers.push_back(std::thread(&CAJobSystem::workerLoop, this, i + 1));
+	}
+}
+
+//
+// FUNCIN: CAJobSystem::~CAJobSystem()
+//
+// PROPSITO: Detiene y espera a los hilos de trabajo
+//
+CAJobSystem::~CAJobSystem()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wakeCondition.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+}
+
+//
+// FUNCIN: CAJobSystem::parallelFor(size_t count, const std::function<void(size_t, uint32_t)>& job)
+//
+// PROPSITO: Ejecuta job(index, worker) para cada ndice en [0, count) repartiendo
+//            los ndices entre los hilos. No retorna hasta que terminan todos.
+//
+void CAJobSystem::parallelFor(size_t count, const std::function<void(size_t index, uint32_t worker)>& job)
+{
+	if (count == 0) return;
+
+	if (workers.empty() || count == 1)
+	{
+		for (size_t i = 0; i < count; i++) job(i, 0);
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		this->job = &job;
+		this->jobCount = count;
+		nextJob = 0;
+		pendingJobs = count;
+		generation++;
+	}
+	wakeCondition.notify_all();
+
+	runJobs(0);
+
+	// Se espera tambin a que los hilos abandonen el bucle para que ninguno
+	// tome ndices del siguiente parallelFor con el trabajo anterior.
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [this] { return pendingJobs == 0 && activeWorkers == 0; });
+	this->job = nullptr;
+}
+
+//
+// FUNCIN: CAJobSystem::getWorkerCount()
+//
+// PROPSITO: Obtiene el nmero de trabajadores, incluido el hilo que llama
+//
+uint32_t CAJobSystem::getWorkerCount()
+{
+	return (uint32_t)workers.size() + 1;
+}
+
+//
+// FUNCIN: CAJobSystem::workerLoop(uint32_t worker)
+//
+// PROPSITO: Bucle de cada hilo de trabajo
+//
+void CAJobSystem::workerLoop(uint32_t worker)
+{
+	uint64_t seen = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [this, seen] { return stop || (generation != seen && job != nullptr); });
+			if (stop) return;
+			seen = generation;
+			activeWorkers++;
+		}
+
+		runJobs(worker);
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			activeWorkers--;
+		}
+		doneCondition.notify_all();
+	}
+}
+
+//
+// FUNCIN: CAJobSystem::runJobs(uint32_t worker)
+//
+// PROPSITO: Consume ndices pendientes del trabajo en curso
+//
+void CAJobSystem::runJobs(uint32_t worker)
+{
+	size_t index;
+	while ((index = nextJob++) < jobCount)
+	{
+		(*job)(index, worker);
+		if (--pendingJobs == 0)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			doneCondition.notify_all();
+		}
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// CLASE: CAJobSystem
+//
+// DESCRIPCIN: Conjunto de hilos de trabajo que reparte bucles paralelos.
+//              El hilo que llama a parallelFor participa como trabajador 0.
+//
+class CAJobSystem
+{
+public:
+	CAJobSystem(uint32_t threads = 0);
+	~CAJobSystem();
+	void parallelFor(size_t count, const std::function<void(size_t index, uint32_t worker)>& job);
+	uint32_t getWorkerCount();
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+	const std::function<void(size_t, uint32_t)>* job = nullptr;
+	size_t jobCount = 0;
+	std::atomic<size_t> nextJob;
+	std::atomic<size_t> pendingJobs;
+	uint32_t activeWorkers = 0;
+	uint64_t generation = 0;
+	bool stop = false;
+
+	void workerLoop(uint32_t worker);
+	void runJobs(uint32_t worker);
+};
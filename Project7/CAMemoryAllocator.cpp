@@ -0,0 +1,368 @@
+#include "CAMemoryAllocator.h"
+#include <algorithm>
+#include <stdexcept>
+
+//
+// FUNCIN: CAMemoryAllocator::CAMemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize)
+//
+// PROPSITO: Crea el asignador. blockSize es el tamao de los bloques compartidos;
+//            en montones pequeos se reduce a una octava parte del montn.
+//
+CAMemoryAllocator::CAMemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize)
+{
+	this->device = device;
+	this->blockSize = blockSize;
+	this->peakUsed = 0;
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	nonCoherentAtomSize = std::max((VkDeviceSize)1, deviceProperties.limits.nonCoherentAtomSize);
+}
+
+//
+// FUNCIN: CAMemoryAllocator::~CAMemoryAllocator()
+//
+// PROPSITO: Libera todos los bloques de memoria
+//
+CAMemoryAllocator::~CAMemoryAllocator()
+{
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		if (blocks[i] != nullptr) destroyBlock((int)i);
+	}
+}
+
+//
+// FUNCIN: CAMemoryAllocator::allocate(const VkMemoryRequirements& requirements, CAMemoryUsage usage)
+//
+// PROPSITO: Reserva memoria para un recurso. Busca hueco en los bloques existentes
+//            del mismo tipo y clase de uso y, si no lo hay, crea un bloque nuevo.
+//
+CAAllocation CAMemoryAllocator::allocate(const VkMemoryRequirements& requirements, CAMemoryUsage usage)
+{
+	uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, usage);
+	VkMemoryPropertyFlags flags = memProperties.memoryTypes[memoryType].propertyFlags;
+
+	// En memoria no coherente los rangos a volcar deben estar alineados a nonCoherentAtomSize
+	VkDeviceSize alignment = std::max((VkDeviceSize)1, requirements.alignment);
+	VkDeviceSize size = requirements.size;
+	if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+	{
+		alignment = std::max(alignment, nonCoherentAtomSize);
+		size = (size + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+	}
+
+	uint32_t heap = memProperties.memoryTypes[memoryType].heapIndex;
+	VkDeviceSize preferredSize = std::min(blockSize, memProperties.memoryHeaps[heap].size / 8);
+
+	CAAllocation allocation = {};
+	if (size > preferredSize / 2)
+	{
+		int index = createBlock(size, memoryType, usage, true);
+		allocateFromBlock(index, size, alignment, &allocation);
+	}
+	else
+	{
+		bool found = false;
+		for (size_t i = 0; i < blocks.size() && !found; i++)
+		{
+			Block* block = blocks[i];
+			if (block == nullptr || block->dedicated || block->memoryType != memoryType || block->usage != usage) continue;
+			found = allocateFromBlock((int)i, size, alignment, &allocation);
+		}
+
+		if (!found)
+		{
+			int index = createBlock(preferredSize, memoryType, usage, false);
+			allocateFromBlock(index, size, alignment, &allocation);
+		}
+	}
+
+	VkDeviceSize used = 0;
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		if (blocks[i] != nullptr) used += blocks[i]->used;
+	}
+	peakUsed = std::max(peakUsed, used);
+
+	return allocation;
+}
+
+//
+// FUNCIN: CAMemoryAllocator::allocateBuffer(VkBuffer buffer, CAMemoryUsage usage)
+//
+// PROPSITO: Reserva memoria para un buffer y la vincula a l
+//
+CAAllocation CAMemoryAllocator::allocateBuffer(VkBuffer buffer, CAMemoryUsage usage)
+{
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+	CAAllocation allocation = allocate(memRequirements, usage);
+
+	if (vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to bind buffer memory!");
+	}
+	return allocation;
+}
+
+//
+// FUNCIN: CAMemoryAllocator::free(CAAllocation& allocation)
+//
+// PROPSITO: Devuelve el rango a la lista de huecos del bloque, fusionndolo con
+//            los huecos vecinos. Los bloques dedicados se liberan al quedar vacos;
+//            de los compartidos se conserva como mucho uno vaco por tipo y uso.
+//
+void CAMemoryAllocator::free(CAAllocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE) return;
+
+	Block* block = blocks[allocation.block];
+	Range range = { allocation.offset, allocation.size };
+
+	std::vector<Range>::iterator next = block->freeList.begin();
+	while (next != block->freeList.end() && next->offset < range.offset) next++;
+
+	if (next != block->freeList.end() && range.offset + range.size == next->offset)
+	{
+		range.size += next->size;
+		next = block->freeList.erase(next);
+	}
+	if (next != block->freeList.begin())
+	{
+		std::vector<Range>::iterator prev = next - 1;
+		if (prev->offset + prev->size == range.offset)
+		{
+			prev->size += range.size;
+			range.size = 0;
+		}
+	}
+	if (range.size > 0) block->freeList.insert(next, range);
+
+	block->allocations--;
+	block->used -= allocation.size;
+
+	if (block->allocations == 0)
+	{
+		bool spare = false;
+		for (size_t i = 0; i < blocks.size() && !block->dedicated; i++)
+		{
+			Block* other = blocks[i];
+			if (other == nullptr || other == block || other->dedicated) continue;
+			if (other->memoryType == block->memoryType && other->usage == block->usage && other->allocations == 0) spare = true;
+		}
+		if (block->dedicated || spare) destroyBlock(allocation.block);
+	}
+
+	allocation.memory = VK_NULL_HANDLE;
+	allocation.mapped = nullptr;
+}
+
+//
+// FUNCIN: CAMemoryAllocator::getNonCoherentAtomSize()
+//
+// PROPSITO: Obtiene la granularidad de los volcados de memoria no coherente
+//
+VkDeviceSize CAMemoryAllocator::getNonCoherentAtomSize()
+{
+	return nonCoherentAtomSize;
+}
+
+//
+// FUNCIN: CAMemoryAllocator::getStats()
+//
+// PROPSITO: Obtiene las estadsticas de uso de la memoria
+//
+CAMemoryStats CAMemoryAllocator::getStats()
+{
+	CAMemoryStats stats = {};
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		Block* block = blocks[i];
+		if (block == nullptr) continue;
+
+		stats.deviceAllocations++;
+		if (block->dedicated) stats.dedicatedCount++;
+		else stats.blockCount++;
+		stats.allocationCount += block->allocations;
+		stats.freeRanges += (uint32_t)block->freeList.size();
+		stats.reservedBytes += block->size;
+		stats.usedBytes += block->used;
+	}
+	stats.peakUsedBytes = peakUsed;
+	return stats;
+}
+
+//
+// FUNCIN: CAMemoryAllocator::findMemoryType(uint32_t typeFilter, CAMemoryUsage usage)
+//
+// PROPSITO: Elige el tipo de memoria para una clase de uso. Se exigen unas
+//            propiedades, se prefieren otras y se evitan las que desperdician
+//            memoria escasa (la de staging no debe ocupar memoria local de la GPU).
+//            En la memoria visible desde el host la coherencia es preferible pero
+//            no obligatoria.
+//
+uint32_t CAMemoryAllocator::findMemoryType(uint32_t typeFilter, CAMemoryUsage usage)
+{
+	VkMemoryPropertyFlags required = 0;
+	VkMemoryPropertyFlags preferred = 0;
+	VkMemoryPropertyFlags avoided = 0;
+
+	switch (usage)
+	{
+	case CA_MEMORY_GPU_ONLY:
+		preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		break;
+	case CA_MEMORY_CPU_TO_GPU:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		break;
+	default:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		avoided = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		break;
+	}
+
+	int best = -1;
+	int bestScore = -1;
+	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+	{
+		VkMemoryPropertyFlags flags = memProperties.memoryTypes[i].propertyFlags;
+		if (!(typeFilter & (1 << i)) || (flags & required) != required) continue;
+
+		int score = 0;
+		if ((flags & preferred) == preferred) score += 4;
+		if ((flags & avoided) == 0) score += 2;
+		if ((required & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) score += 1;
+		if (score > bestScore)
+		{
+			best = (int)i;
+			bestScore = score;
+		}
+	}
+
+	if (best < 0)
+	{
+		throw std::runtime_error("failed to find suitable memory type!");
+	}
+	return (uint32_t)best;
+}
+
+//
+// FUNCIN: CAMemoryAllocator::createBlock(VkDeviceSize size, uint32_t memoryType, CAMemoryUsage usage, bool dedicated)
+//
+// PROPSITO: Reserva un bloque de memoria del dispositivo y lo mapea si es visible
+//            desde el host. Reutiliza los huecos de la lista de bloques.
+//
+int CAMemoryAllocator::createBlock(VkDeviceSize size, uint32_t memoryType, CAMemoryUsage usage, bool dedicated)
+{
+	Block* block = new Block();
+	block->size = size;
+	block->memoryType = memoryType;
+	block->usage = usage;
+	block->dedicated = dedicated;
+	block->mapped = nullptr;
+	block->allocations = 0;
+	block->used = 0;
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	if (vkAllocateMemory(device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS)
+	{
+		delete block;
+		throw std::runtime_error("failed to allocate memory block!");
+	}
+
+	if (memProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		void* data;
+		if (vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS)
+		{
+			vkFreeMemory(device, block->memory, nullptr);
+			delete block;
+			throw std::runtime_error("failed to map memory block!");
+		}
+		block->mapped = (char*)data;
+	}
+
+	Range all = { 0, size };
+	block->freeList.push_back(all);
+
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		if (blocks[i] == nullptr)
+		{
+			blocks[i] = block;
+			return (int)i;
+		}
+	}
+	blocks.push_back(block);
+	return (int)blocks.size() - 1;
+}
+
+//
+// FUNCIN: CAMemoryAllocator::destroyBlock(int index)
+//
+// PROPSITO: Libera un bloque de memoria del dispositivo
+//
+void CAMemoryAllocator::destroyBlock(int index)
+{
+	Block* block = blocks[index];
+	if (block->mapped != nullptr) vkUnmapMemory(device, block->memory);
+	vkFreeMemory(device, block->memory, nullptr);
+	delete block;
+	blocks[index] = nullptr;
+}
+
+//
+// FUNCIN: CAMemoryAllocator::allocateFromBlock(int index, VkDeviceSize size, VkDeviceSize alignment, CAAllocation* allocation)
+//
+// PROPSITO: Busca en la lista de huecos del bloque el primero donde quepa el rango
+//            alineado. El relleno de alineacin que queda delante vuelve a la lista.
+//
+bool CAMemoryAllocator::allocateFromBlock(int index, VkDeviceSize size, VkDeviceSize alignment, CAAllocation* allocation)
+{
+	Block* block = blocks[index];
+	VkMemoryPropertyFlags flags = memProperties.memoryTypes[block->memoryType].propertyFlags;
+
+	for (size_t i = 0; i < block->freeList.size(); i++)
+	{
+		Range range = block->freeList[i];
+		VkDeviceSize offset = (range.offset + alignment - 1) / alignment * alignment;
+		if (offset + size > range.offset + range.size) continue;
+
+		VkDeviceSize before = offset - range.offset;
+		VkDeviceSize after = range.offset + range.size - (offset + size);
+
+		block->freeList.erase(block->freeList.begin() + i);
+		if (after > 0)
+		{
+			Range tail = { offset + size, after };
+			block->freeList.insert(block->freeList.begin() + i, tail);
+		}
+		if (before > 0)
+		{
+			Range head = { range.offset, before };
+			block->freeList.insert(block->freeList.begin() + i, head);
+		}
+
+		block->allocations++;
+		block->used += size;
+
+		allocation->memory = block->memory;
+		allocation->offset = offset;
+		allocation->size = size;
+		allocation->block = index;
+		allocation->mapped = (block->mapped != nullptr) ? block->mapped + offset : nullptr;
+		allocation->coherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+#include "CAAllocation.h"
+
+//
+// ENUMERACIN: CAMemoryUsage
+//
+// DESCRIPCIN: Clase de uso de una reserva. Cada clase usa sus propios bloques para
+//              que la memoria de subida (mapeada) no se mezcle con la local de la GPU.
+//
+enum CAMemoryUsage {
+	CA_MEMORY_GPU_ONLY,
+	CA_MEMORY_CPU_TO_GPU,
+	CA_MEMORY_STAGING,
+	CA_MEMORY_USAGE_COUNT
+};
+
+//
+// ESTRUCTURA: CAMemoryStats
+//
+// DESCRIPCIN: Estadsticas del asignador. deviceAllocations es el nmero de
+//              llamadas a vkAllocateMemory vivas (limitado por maxMemoryAllocationCount).
+//
+struct CAMemoryStats {
+	uint32_t deviceAllocations;
+	uint32_t blockCount;
+	uint32_t dedicatedCount;
+	uint32_t allocationCount;
+	uint32_t freeRanges;
+	VkDeviceSize reservedBytes;
+	VkDeviceSize usedBytes;
+	VkDeviceSize peakUsedBytes;
+};
+
+//
+// CLASE: CAMemoryAllocator
+//
+// DESCRIPCIN: Asignador de memoria del dispositivo. Reserva bloques grandes de
+//              VkDeviceMemory por tipo de memoria y clase de uso y reparte los buffers
+//              dentro de ellos con una lista de huecos libres (primer ajuste, con
+//              fusin de huecos vecinos al liberar). Las peticiones grandes reciben
+//              una reserva dedicada. Los bloques visibles desde el host se mapean
+//              una sola vez al crearlos, ya que Vulkan slo permite un mapeo a la vez
+//              por VkDeviceMemory. La memoria visible puede no ser coherente: en ese
+//              caso las reservas se alinean a nonCoherentAtomSize y quien escribe en
+//              ellas debe volcar los rangos (CAAllocation::coherent = false).
+//
+class CAMemoryAllocator
+{
+public:
+	CAMemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize = 16 * 1024 * 1024);
+	~CAMemoryAllocator();
+	CAAllocation allocate(const VkMemoryRequirements& requirements, CAMemoryUsage usage);
+	CAAllocation allocateBuffer(VkBuffer buffer, CAMemoryUsage usage);
+	void free(CAAllocation& allocation);
+	VkDeviceSize getNonCoherentAtomSize();
+	CAMemoryStats getStats();
+
+private:
+	struct Range {
+		VkDeviceSize offset;
+		VkDeviceSize size;
+	};
+
+	struct Block {
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		uint32_t memoryType;
+		CAMemoryUsage usage;
+		bool dedicated;
+		char* mapped;
+		uint32_t allocations;
+		VkDeviceSize used;
+		std::vector<Range> freeList;
+	};
+
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memProperties;
+	VkDeviceSize blockSize;
+	VkDeviceSize nonCoherentAtomSize;
+	std::vector<Block*> blocks;
+	VkDeviceSize peakUsed;
+
+	uint32_t findMemoryType(uint32_t typeFilter, CAMemoryUsage usage);
+	int createBlock(VkDeviceSize size, uint32_t memoryType, CAMemoryUsage usage, bool dedicated);
+	void destroyBlock(int index);
+	bool allocateFromBlock(int index, VkDeviceSize size, VkDeviceSize alignment, CAAllocation* allocation);
+};
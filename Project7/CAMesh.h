@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+typedef struct
+{
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t vertexCount;
+} CAMesh;
@@ -1,6 +1,5 @@
 #include "CAModel.h"
 
-#include "CATransform.h"
 #include "CACylinder.h"
 #include "CASphere.h"
 #include <iostream>
@@ -20,7 +19,8 @@ CAModel::CAModel(CAVulkanState* vulkan)
 	this->camera->setPosition(glm::vec3(0.0f, 1.0f, 10.0f));
 	this->camera->setMoveStep(0.0f);
 
-	this->scene = new CAScene(vulkan);
+	this->jobs = new CAJobSystem();
+	this->scene = new CAScene(vulkan, jobs);
 }
 
 //
@@ -30,19 +30,29 @@ CAModel::CAModel(CAVulkanState* vulkan)
 //
 CAModel::~CAModel()
 {
-	scene->finalize(vulkan);
 	delete scene;
 	delete camera;
+	delete jobs;
 }
 
 //
-// FUNCIN: CAModel::addCommands(VkCommandBuffer commandBuffer, int index)
+// FUNCIN: CAModel::getJobSystem()
 //
-// PROPSITO: Aade los comandos de renderizado al command buffer
+// PROPSITO: Obtiene los hilos de trabajo compartidos por la escena y el renderizado
 //
-void CAModel::addCommands(VkCommandBuffer commandBuffer, int index)
+CAJobSystem* CAModel::getJobSystem()
 {
-	scene->addCommands(vulkan, commandBuffer, index);
+	return jobs;
+}
+
+//
+// FUNCIN: CAModel::setFixedTimestep(float step)
+//
+// PROPSITO: Fija el paso de tiempo de la simulacin de la escena (0 = tiempo real)
+//
+void CAModel::setFixedTimestep(float step)
+{
+	scene->setFixedTimestep(step);
 }
 
 //
@@ -81,6 +91,8 @@ void CAModel::update()
 //
 void CAModel::key_pressed(int key)
 {
+	CAPresentSettings settings;
+
 	switch (key)
 	{
 	case GLFW_KEY_UP:
@@ -143,7 +155,67 @@ void CAModel::key_pressed(int key)
 	case GLFW_KEY_3: // para avanzar animacion
 		scene->setIncremento(0.02f);
 		break;
+	case GLFW_KEY_R: // para activar/desactivar el ragdoll del personaje elegido
+		if (ragdollCharacter >= scene->getCharacterCount()) ragdollCharacter = 0;
+		scene->toggleRagdoll(ragdollCharacter);
+		break;
+	case GLFW_KEY_T: // para elegir el siguiente personaje del ragdoll
+		ragdollCharacter = (ragdollCharacter + 1) % scene->getCharacterCount();
+		break;
+	case GLFW_KEY_Y: // para activar/desactivar el ragdoll de todos los personajes
+		for (int i = 0; i < scene->getCharacterCount(); i++) scene->toggleRagdoll(i);
+		break;
+	case GLFW_KEY_G: // para alternar el andar procedural y el de keyframes
+		scene->toggleGait();
+		break;
+	case GLFW_KEY_B: // para alternar los lotes de piezas y el dibujo por paleta de matrices
+		scene->toggleSkinned();
+		break;
+	case GLFW_KEY_N: // para aadir un personaje
+		scene->spawnCharacter(vulkan);
+		break;
+	case GLFW_KEY_D: // para eliminar el ltimo personaje aadido
+		scene->despawnCharacter();
+		break;
+	case GLFW_KEY_M: // para cambiar el modo de presentacin (FIFO, FIFO_RELAXED, MAILBOX, IMMEDIATE)
+		cyclePresentMode();
+		break;
+	case GLFW_KEY_F: // para activar/desactivar el limitador a 60 fotogramas por segundo
+		settings = vulkan->getPresentSettings();
+		settings.frameRateLimit = (settings.frameRateLimit > 0.0f) ? 0.0f : 60.0f;
+		vulkan->setPresentSettings(settings);
+		break;
+	case GLFW_KEY_I: // para mostrar/ocultar en consola la latencia entrada-presentacin
+		settings = vulkan->getPresentSettings();
+		settings.reportLatency = !settings.reportLatency;
+		vulkan->setPresentSettings(settings);
+		break;
+	}
+}
+
+//
+// FUNCIN: CAModel::cyclePresentMode()
+//
+// PROPSITO: Pasa al siguiente modo de presentacin. Si el dispositivo no lo admite
+//            CAVulkanState usa el ms parecido.
+//
+void CAModel::cyclePresentMode()
+{
+	static const VkPresentModeKHR modes[] = {
+		VK_PRESENT_MODE_FIFO_KHR,
+		VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+		VK_PRESENT_MODE_MAILBOX_KHR,
+		VK_PRESENT_MODE_IMMEDIATE_KHR
+	};
+
+	CAPresentSettings settings = vulkan->getPresentSettings();
+	size_t next = 0;
+	for (size_t i = 0; i < 4; i++)
+	{
+		if (modes[i] == settings.presentMode) next = (i + 1) % 4;
 	}
+	settings.presentMode = modes[next];
+	vulkan->setPresentSettings(settings);
 }
 
 //
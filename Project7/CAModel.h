@@ -3,6 +3,7 @@
 #include "CAVulkanState.h"
 #include "CAScene.h"
 #include "CACamera.h"
+#include "CAJobSystem.h"
 
 
 class CAModel
@@ -14,17 +15,21 @@ private:
 	float time = 0.0f;
 	CAScene* scene;
 	CACamera* camera;
+	CAJobSystem* jobs;
+	int ragdollCharacter = 0;
 
 public:
 	CAModel(CAVulkanState* vulkan);
 	~CAModel();
 
-	void addCommands(VkCommandBuffer commandBuffer, int index);
 	void update();
 	void key_pressed(int key);
 	void mouse_button(int button, int action);
 	void mouse_move(double xpos, double ypos);
 	void aspect_ratio(double aspect);
+	CAJobSystem* getJobSystem();
+	void setFixedTimestep(float step);
+	void cyclePresentMode();
 };
 
 
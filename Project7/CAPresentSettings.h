@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+
+//
+// ESTRUCTURA: CAPresentSettings
+//
+// DESCRIPCIN: Opciones de presentacin y latencia. Si el modo de presentacin pedido
+//              no est disponible se usa el ms parecido (FIFO siempre lo est).
+//              framesInFlight es el nmero de fotogramas que la CPU puede adelantarse
+//              a la GPU; el limitador retrasa el inicio de cada fotograma (y la lectura
+//              de la entrada) hasta justo antes de que haga falta.
+//
+typedef struct
+{
+	VkPresentModeKHR presentMode;
+	uint32_t framesInFlight;
+	float frameRateLimit;       // Fotogramas por segundo (0 = sin lmite)
+	bool reportLatency;         // Muestra en consola la latencia entrada-presentacin
+} CAPresentSettings;
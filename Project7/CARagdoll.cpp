@@ -0,0 +1,436 @@
+#include "CARagdoll.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cmath>
+
+#define RAGDOLL_ITERATIONS 8
+#define RAGDOLL_MAX_SUBSTEPS 4
+#define RAGDOLL_DAMPING 0.99f
+#define RAGDOLL_RADIUS 0.1f
+#define RAGDOLL_FRICTION 0.5f
+#define RAGDOLL_ANGLE_STIFFNESS 0.5f
+
+static const glm::vec3 GRAVITY = glm::vec3(0.0f, -9.8f, 0.0f);
+
+//
+// FUNCIN: CARagdoll::CARagdoll(CASkeleton* skeleton)
+//
+// PROPSITO: Construye las partculas y restricciones del ragdoll a partir de las
+//            articulaciones del esqueleto
+//
+CARagdoll::CARagdoll(CASkeleton* skeleton)
+{
+	this->skeleton = skeleton;
+
+	std::vector<CABalljoint*> roots = skeleton->getHijas();
+	for (size_t i = 0; i < roots.size(); i++)
+	{
+		addJoints(roots[i], -1);
+	}
+
+	position.resize(2 * joints.size());
+	previous.resize(2 * joints.size());
+	startParticle.resize(joints.size());
+	endParticle.resize(joints.size());
+	twist.assign(joints.size(), 0.0f);
+
+	for (size_t i = 0; i < joints.size(); i++)
+	{
+		startParticle[i] = (int)(2 * i);
+		endParticle[i] = (int)(2 * i + 1);
+	}
+
+	buildConstraints();
+}
+
+//
+// FUNCIN: CARagdoll::~CARagdoll()
+//
+// PROPSITO: Destruye el ragdoll (el esqueleto no es propiedad del ragdoll)
+//
+CARagdoll::~CARagdoll()
+{
+	joints.clear();
+}
+
+//
+// FUNCIN: CARagdoll::addJoints(CABalljoint* joint, int parent)
+//
+// PROPSITO: Recorre la jerarqua en profundidad guardando cada articulacin con
+//            el ndice de su padre
+//
+void CARagdoll::addJoints(CABalljoint* joint, int parent)
+{
+	int index = (int)joints.size();
+	joints.push_back(joint);
+	parents.push_back(parent);
+
+	std::vector<CABalljoint*> hijas = joint->getHijas();
+	for (size_t i = 0; i < hijas.size(); i++)
+	{
+		addJoints(hijas[i], index);
+	}
+}
+
+//
+// FUNCIN: CARagdoll::buildConstraints()
+//
+// PROPSITO: Genera las restricciones de distancia (huesos, uniones con el padre y
+//            unin rgida de las races) y las restricciones de ngulo con los
+//            lmites de cada articulacin en X, Y y Z
+//
+void CARagdoll::buildConstraints()
+{
+	for (size_t i = 0; i < joints.size(); i++)
+	{
+		glm::mat4 m = joints[i]->getMatrix();
+		position[startParticle[i]] = glm::vec3(m[3]);
+		position[endParticle[i]] = glm::vec3(m * glm::vec4(0.0f, 0.0f, joints[i]->getLength(), 1.0f));
+	}
+
+	std::vector<int> roots;
+	for (size_t i = 0; i < joints.size(); i++)
+	{
+		distances.push_back({ startParticle[i], endParticle[i], joints[i]->getLength() });
+
+		int p = parents[i];
+		if (p < 0)
+		{
+			roots.push_back((int)i);
+			continue;
+		}
+
+		float link = glm::length(position[startParticle[i]] - position[endParticle[p]]);
+		distances.push_back({ endParticle[p], startParticle[i], link });
+
+		// Los ngulos de la pose se miden desde la orientacin de reposo en el
+		// sistema del padre, con el mismo orden que CABalljoint (Z * Y * X)
+		glm::mat2x3 limit = joints[i]->getLimit();
+		if (limit[0][0] <= -180.0f && limit[1][0] >= 180.0f
+			&& limit[0][1] <= -180.0f && limit[1][1] >= 180.0f
+			&& limit[0][2] <= -180.0f && limit[1][2] >= 180.0f) continue;
+
+		AngleConstraint c;
+		c.joint = (int)i;
+		c.parent = p;
+		c.rest = joints[i]->getOrientation();
+		c.minAngle = glm::radians(limit[0]);
+		c.maxAngle = glm::radians(limit[1]);
+		angles.push_back(c);
+	}
+
+	// Las races (pelvis y caderas) forman un bloque rgido
+	std::vector<int> rootParticles;
+	for (size_t i = 0; i < roots.size(); i++)
+	{
+		rootParticles.push_back(startParticle[roots[i]]);
+		rootParticles.push_back(endParticle[roots[i]]);
+	}
+	for (size_t i = 0; i < rootParticles.size(); i++)
+	{
+		for (size_t j = i + 1; j < rootParticles.size(); j++)
+		{
+			int a = rootParticles[i];
+			int b = rootParticles[j];
+			if (a / 2 == b / 2) continue;
+			distances.push_back({ a, b, glm::length(position[a] - position[b]) });
+		}
+	}
+}
+
+//
+// FUNCIN: CARagdoll::activate(glm::vec3 velocity)
+//
+// PROPSITO: Pasa el esqueleto a modo ragdoll partiendo de la pose actual y con la
+//            velocidad inicial indicada
+//
+void CARagdoll::activate(glm::vec3 velocity)
+{
+	for (size_t i = 0; i < joints.size(); i++)
+	{
+		glm::mat4 m = joints[i]->getMatrix();
+		position[startParticle[i]] = glm::vec3(m[3]);
+		position[endParticle[i]] = glm::vec3(m * glm::vec4(0.0f, 0.0f, joints[i]->getLength(), 1.0f));
+	}
+
+	// La velocidad se expresa como desplazamiento respecto a la posicin anterior
+	// usando un paso nominal de 1/60 s.
+	for (size_t i = 0; i < position.size(); i++)
+	{
+		previous[i] = position[i] - velocity * (1.0f / 60.0f);
+	}
+
+	// El giro en Z no se deduce de las partculas: se parte del de la animacin
+	for (size_t i = 0; i < angles.size(); i++)
+	{
+		const AngleConstraint& c = angles[i];
+		glm::mat3 basis = glm::mat3(joints[c.parent]->getMatrix()) * c.rest;
+		twist[c.joint] = CABalljoint::poseAngles(glm::transpose(basis) * glm::mat3(joints[c.joint]->getMatrix())).z;
+	}
+
+	active = true;
+}
+
+//
+// FUNCIN: CARagdoll::deactivate()
+//
+// PROPSITO: Devuelve el control del esqueleto a la animacin
+//
+void CARagdoll::deactivate()
+{
+	active = false;
+	skeleton->resolve();
+}
+
+//
+// FUNCIN: CARagdoll::isActive()
+//
+// PROPSITO: Indica si el esqueleto est en modo ragdoll
+//
+bool CARagdoll::isActive()
+{
+	return active;
+}
+
+//
+// FUNCIN: CARagdoll::getSkeleton()
+//
+// PROPSITO: Obtiene el esqueleto simulado
+//
+CASkeleton* CARagdoll::getSkeleton()
+{
+	return skeleton;
+}
+
+//
+// FUNCIN: CARagdoll::step(float dt)
+//
+// PROPSITO: Avanza la simulacin un paso: integracin de Verlet y resolucin
+//            iterativa de las restricciones
+//
+void CARagdoll::step(float dt)
+{
+	glm::vec3 g = GRAVITY * (dt * dt);
+	for (size_t i = 0; i < position.size(); i++)
+	{
+		glm::vec3 v = (position[i] - previous[i]) * RAGDOLL_DAMPING;
+		previous[i] = position[i];
+		position[i] += v + g;
+	}
+
+	for (int it = 0; it < RAGDOLL_ITERATIONS; it++)
+	{
+		for (size_t i = 0; i < distances.size(); i++) solveDistance(distances[i]);
+		for (size_t i = 0; i < angles.size(); i++) solveAngle(angles[i]);
+		for (size_t i = 0; i < position.size(); i++) solveGround((int)i);
+	}
+}
+
+//
+// FUNCIN: CARagdoll::solveDistance(const DistanceConstraint& c)
+//
+// PROPSITO: Proyecta una restriccin de distancia entre dos partculas
+//
+void CARagdoll::solveDistance(const DistanceConstraint& c)
+{
+	glm::vec3 d = position[c.b] - position[c.a];
+	float len = glm::length(d);
+
+	if (c.rest <= 0.0f || len < 1e-6f)
+	{
+		glm::vec3 mid = (position[c.a] + position[c.b]) * 0.5f;
+		position[c.a] = mid;
+		position[c.b] = mid;
+		return;
+	}
+
+	glm::vec3 corr = d * (0.5f * (len - c.rest) / len);
+	position[c.a] += corr;
+	position[c.b] -= corr;
+}
+
+//
+// FUNCIN: CARagdoll::solveAngle(const AngleConstraint& c)
+//
+// PROPSITO: Lleva la direccin del hueso hijo al rango permitido. La direccin se
+//            expresa en la orientacin de reposo respecto al padre, se descuenta el
+//            giro en Z actual y se descompone en los ngulos X e Y con signo, que se
+//            limitan por separado (en las bisagras Y queda fijo a 0). Como la
+//            descomposicin tiene dos soluciones se usa la ms cercana al rango.
+//
+void CARagdoll::solveAngle(const AngleConstraint& c)
+{
+	int childStart = startParticle[c.joint];
+	int childEnd = endParticle[c.joint];
+	glm::vec3 b = position[childEnd] - position[childStart];
+	float blen = glm::length(b);
+	if (blen < 1e-6f) return;
+
+	glm::mat3 basis = boneFrame(c.parent) * c.rest * CABalljoint::poseRotation(glm::vec3(0.0f, 0.0f, twist[c.joint]));
+	glm::vec3 d = glm::transpose(basis) * (b / blen);
+
+	// Rx y luego Ry sobre el eje Z dan (sin y cos x, -sin x, cos y cos x)
+	float x1 = (float)asin(glm::clamp(-d.y, -1.0f, 1.0f));
+	float y1 = (float)atan2(d.x, d.z);
+	float x2 = (x1 >= 0.0f ? glm::pi<float>() : -glm::pi<float>()) - x1;
+	float y2 = (float)atan2(-d.x, -d.z);
+
+	float cx1 = glm::clamp(x1, c.minAngle.x, c.maxAngle.x);
+	float cy1 = glm::clamp(y1, c.minAngle.y, c.maxAngle.y);
+	float cx2 = glm::clamp(x2, c.minAngle.x, c.maxAngle.x);
+	float cy2 = glm::clamp(y2, c.minAngle.y, c.maxAngle.y);
+	float error1 = fabs(x1 - cx1) + fabs(y1 - cy1);
+	float error2 = fabs(x2 - cx2) + fabs(y2 - cy2);
+	if (error1 <= 0.0f || error2 <= 0.0f) return;
+
+	float x = (error1 <= error2) ? cx1 : cx2;
+	float y = (error1 <= error2) ? cy1 : cy2;
+	glm::vec3 dir = basis * glm::vec3((float)(sin(y) * cos(x)), (float)-sin(x), (float)(cos(y) * cos(x)));
+	glm::vec3 goal = position[childStart] + dir * blen;
+	position[childEnd] += (goal - position[childEnd]) * RAGDOLL_ANGLE_STIFFNESS;
+}
+
+//
+// FUNCIN: CARagdoll::solveGround(int particle)
+//
+// PROPSITO: Impide que una partcula atraviese el suelo (plano y = 0) y aplica
+//            rozamiento a la velocidad tangencial
+//
+void CARagdoll::solveGround(int particle)
+{
+	glm::vec3& p = position[particle];
+	if (p.y >= RAGDOLL_RADIUS) return;
+
+	p.y = RAGDOLL_RADIUS;
+	glm::vec3& q = previous[particle];
+	q.x += (p.x - q.x) * RAGDOLL_FRICTION;
+	q.z += (p.z - q.z) * RAGDOLL_FRICTION;
+}
+
+//
+// FUNCIN: CARagdoll::boneFrame(int joint)
+//
+// PROPSITO: Orientacin de un hueso a partir de sus partculas conservando, en lo
+//            posible, el vector up de su matriz anterior
+//
+glm::mat3 CARagdoll::boneFrame(int joint)
+{
+	glm::mat4 old = joints[joint]->getMatrix();
+	glm::vec3 d = position[endParticle[joint]] - position[startParticle[joint]];
+	if (glm::length(d) < 1e-6f) d = glm::vec3(old[2]);
+
+	glm::vec3 dir = glm::normalize(d);
+	glm::vec3 up = glm::vec3(old[1]);
+	up = up - dir * glm::dot(up, dir);
+	if (glm::length(up) < 1e-6f) up = glm::cross(dir, glm::vec3(old[0]));
+	up = glm::normalize(up);
+	return glm::mat3(glm::cross(up, dir), up, dir);
+}
+
+//
+// FUNCIN: CARagdoll::apply()
+//
+// PROPSITO: Reconstruye la matriz de cada articulacin a partir de sus partculas
+//            y despus limita sus ngulos respecto al padre, lo que incluye el giro
+//            en Z que las partculas no ven. Las articulaciones estn en
+//            preorden, as que cada padre se limita antes que sus hijas.
+//
+void CARagdoll::apply()
+{
+	for (size_t i = 0; i < joints.size(); i++)
+	{
+		glm::mat3 r = boneFrame((int)i);
+		glm::vec3 start = position[startParticle[i]];
+		glm::mat4 m = glm::mat4(glm::vec4(r[0], 0.0f), glm::vec4(r[1], 0.0f), glm::vec4(r[2], 0.0f), glm::vec4(start, 1.0f));
+		joints[i]->setMatrix(m);
+	}
+
+	for (size_t i = 0; i < angles.size(); i++)
+	{
+		const AngleConstraint& c = angles[i];
+		glm::mat3 basis = glm::mat3(joints[c.parent]->getMatrix()) * c.rest;
+		glm::mat4 m = joints[c.joint]->getMatrix();
+		glm::vec3 pose = CABalljoint::poseAngles(glm::transpose(basis) * glm::mat3(m));
+		pose = glm::clamp(pose, c.minAngle, c.maxAngle);
+		twist[c.joint] = pose.z;
+
+		glm::mat3 r = basis * CABalljoint::poseRotation(pose);
+		m = glm::mat4(glm::vec4(r[0], 0.0f), glm::vec4(r[1], 0.0f), glm::vec4(r[2], 0.0f), m[3]);
+		joints[c.joint]->setMatrix(m);
+	}
+}
+
+//
+// FUNCIN: CARagdollWorld::CARagdollWorld(CAJobSystem* jobs, float timestep)
+//
+// PROPSITO: Crea el mundo de simulacin con el paso de tiempo fijo indicado
+//
+CARagdollWorld::CARagdollWorld(CAJobSystem* jobs, float timestep)
+{
+	this->jobs = jobs;
+	this->timestep = timestep;
+}
+
+//
+// FUNCIN: CARagdollWorld::~CARagdollWorld()
+//
+// PROPSITO: Destruye el mundo de simulacin (los ragdolls no son de su propiedad)
+//
+CARagdollWorld::~CARagdollWorld()
+{
+	ragdolls.clear();
+}
+
+//
+// FUNCIN: CARagdollWorld::addRagdoll(CARagdoll* ragdoll)
+//
+// PROPSITO: Aade un ragdoll a la simulacin
+//
+void CARagdollWorld::addRagdoll(CARagdoll* ragdoll)
+{
+	ragdolls.push_back(ragdoll);
+}
+
+//
+// FUNCIN: CARagdollWorld::removeRagdoll(CARagdoll* ragdoll)
+//
+// PROPSITO: Quita un ragdoll de la simulacin
+//
+void CARagdollWorld::removeRagdoll(CARagdoll* ragdoll)
+{
+	ragdolls.erase(std::remove(ragdolls.begin(), ragdolls.end(), ragdoll), ragdolls.end());
+}
+
+//
+// FUNCIN: CARagdollWorld::step(float dt)
+//
+// PROPSITO: Acumula el tiempo transcurrido y ejecuta los pasos fijos pendientes.
+//            Cada isla (ragdoll) se simula en un trabajo independiente.
+//
+void CARagdollWorld::step(float dt)
+{
+	accumulator += dt;
+	int steps = 0;
+	while (accumulator >= timestep && steps < RAGDOLL_MAX_SUBSTEPS)
+	{
+		accumulator -= timestep;
+		steps++;
+	}
+	// Si no se alcanza, se descarta el exceso pero no el resto del paso
+	if (steps == RAGDOLL_MAX_SUBSTEPS) accumulator = std::min(accumulator, timestep);
+	if (steps == 0) return;
+
+	activeRagdolls.clear();
+	for (size_t i = 0; i < ragdolls.size(); i++)
+	{
+		if (ragdolls[i]->isActive()) activeRagdolls.push_back(ragdolls[i]);
+	}
+
+	float h = timestep;
+	jobs->parallelFor(activeRagdolls.size(), [this, steps, h](size_t index, uint32_t worker) {
+		CARagdoll* ragdoll = activeRagdolls[index];
+		for (int s = 0; s < steps; s++) ragdoll->step(h);
+		ragdoll->apply();
+	});
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "CASkeleton.h"
+#include "CAJobSystem.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+//
+// CLASE: CARagdoll
+//
+// DESCRIPCIN: Simulacin de un esqueleto como ragdoll mediante dinmica basada en
+//              posiciones (PBD). Cada hueso se representa con dos partculas (origen y
+//              extremo) unidas por restricciones de distancia; los lmites de giro de
+//              cada CABalljoint se imponen por ejes en el sistema del hueso padre.
+//              Cada ragdoll es una isla independiente del resto.
+//
+class CARagdoll
+{
+public:
+	CARagdoll(CASkeleton* skeleton);
+	~CARagdoll();
+	void activate(glm::vec3 velocity);
+	void deactivate();
+	bool isActive();
+	void step(float dt);
+	void apply();
+	CASkeleton* getSkeleton();
+
+private:
+	struct DistanceConstraint
+	{
+		int a;
+		int b;
+		float rest;
+	};
+
+	// Lmites por ejes (radianes) de una articulacin con la orientacin de reposo
+	// (rest) expresada en el sistema del hueso padre
+	struct AngleConstraint
+	{
+		int joint;
+		int parent;
+		glm::mat3 rest;
+		glm::vec3 minAngle;
+		glm::vec3 maxAngle;
+	};
+
+	CASkeleton* skeleton;
+	bool active = false;
+
+	std::vector<CABalljoint*> joints;
+	std::vector<int> parents;
+	std::vector<int> startParticle;
+	std::vector<int> endParticle;
+
+	std::vector<glm::vec3> position;
+	std::vector<glm::vec3> previous;
+	std::vector<float> twist;
+	std::vector<DistanceConstraint> distances;
+	std::vector<AngleConstraint> angles;
+
+	void addJoints(CABalljoint* joint, int parent);
+	void buildConstraints();
+	void solveDistance(const DistanceConstraint& c);
+	void solveAngle(const AngleConstraint& c);
+	void solveGround(int particle);
+	glm::mat3 boneFrame(int joint);
+};
+
+//
+// CLASE: CARagdollWorld
+//
+// DESCRIPCIN: Avanza todos los ragdolls activos con paso de tiempo fijo, repartiendo
+//              las islas entre los hilos del CAJobSystem.
+//
+class CARagdollWorld
+{
+public:
+	CARagdollWorld(CAJobSystem* jobs, float timestep);
+	~CARagdollWorld();
+	void addRagdoll(CARagdoll* ragdoll);
+	void removeRagdoll(CARagdoll* ragdoll);
+	void step(float dt);
+
+private:
+	CAJobSystem* jobs;
+	float timestep;
+	float accumulator = 0.0f;
+	std::vector<CARagdoll*> ragdolls;
+	std::vector<CARagdoll*> activeRagdolls;
+};
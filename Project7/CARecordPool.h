@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+//
+// ESTRUCTURA: CARecordPool
+//
+// DESCRIPCIN: Command pool de un trabajo de grabacin y los command buffers secundarios
+//              que se han reservado en l. Cada pool slo lo usa un hilo a la vez.
+//
+typedef struct
+{
+	VkCommandPool pool;
+	std::vector<VkCommandBuffer> buffers;
+} CARecordPool;
+
+//
+// ESTRUCTURA: CARecordedPartition
+//
+// DESCRIPCIN: Lo que se grab en el command buffer secundario de una particin: la
+//              generacin de los recursos enlazados y los dibujos del rango.
+//              generation = 0 indica que la particin nunca se ha grabado.
+//
+typedef struct
+{
+	uint64_t generation;
+	std::vector<VkDrawIndexedIndirectCommand> draws;
+} CARecordedPartition;
@@ -1,19 +1,22 @@
 #include "CAScene.h"
-#include "CATransform.h"
+#include "CASceneInfo.h"
 #include "CACylinder.h"
 #include "CASphere.h"
 #include "CAGround.h"
 #include "CABalljoint.h"
 #include <iostream>
+#include <algorithm>
+
+#define SCENE_CROWD_SIZE 8
 
 //
-// FUNCIN: CAScene::CAScene(CAVulkanState* vulkan)
+// FUNCIN: CAScene::CAScene(CAVulkanState* vulkan, CAJobSystem* jobs)
 //
 // PROPSITO: Construye el objeto que representa la escena
 //
-CAScene::CAScene(CAVulkanState* vulkan)
+CAScene::CAScene(CAVulkanState* vulkan, CAJobSystem* jobs)
 {
-	CALight light = {};
+	light = {};
 	light.Ldir = glm::normalize(glm::vec3(1.0f, -0.8f, -0.7f));
 	light.La = glm::vec3(0.2f, 0.2f, 0.2f);
 	light.Ld = glm::vec3(0.8f, 0.8f, 0.8f);
@@ -27,55 +30,142 @@ CAScene::CAScene(CAVulkanState* vulkan)
 
 	ground = new CAGround(5.0f, 5.0f);
 	ground->initialize(vulkan);
-	ground->setLight(light);
-	ground->setMaterial(groundMat);
+	ground->setMaterial(vulkan, groundMat);
+
+	// Las esferas y cilindros de todos los personajes se dibujan como instancias
+	jointBatch = new CAInstanceBatch(new CASphere(10, 20, 0.1f));
+	jointBatch->initialize(vulkan);
+	boneBatch = new CAInstanceBatch(new CACylinder(2, 10, 0.05f, 1.0f));
+	boneBatch->initialize(vulkan);
+
+	this->jobs = jobs;
+	crowd = new CACrowd(jobs, 5.0f, 5.0f, 1.0f);
+	collisions = new CACollisionWorld(jobs, 5.0f, 5.0f);
+	ragdollWorld = new CARagdollWorld(jobs, 1.0f / 60.0f);
+
+	// Los personajes empiezan en dos filas mirando hacia +z
+	for (int i = 0; i < SCENE_CROWD_SIZE; i++)
+	{
+		float x = -3.0f + 2.0f * (float)(i % (SCENE_CROWD_SIZE / 2));
+		float z = (i < SCENE_CROWD_SIZE / 2) ? -3.0f : -1.5f;
+		addCharacter(vulkan, glm::vec2(x, z), (float)i / (float)SCENE_CROWD_SIZE);
+	}
 
+	esqueleto = esqueletos[0];
+	animacion = animaciones[0];
+	lastUpdate = std::chrono::steady_clock::now();
+}
+
+//
+// FUNCIN: CAScene::addCharacter(CAVulkanState* vulkan, glm::vec2 position, float phase)
+//
+// PROPSITO: Crea un personaje en el plano del suelo mirando hacia +z y lo aade a la
+//            multitud, al mundo de colisiones y al de ragdolls (inactivo).
+//            phase es la fase inicial del andar.
+//
+void CAScene::addCharacter(CAVulkanState* vulkan, glm::vec2 position, float phase)
+{
 	CAMaterial blueMat = {};
 	blueMat.Ka = glm::vec3(0.0f, 0.0f, 0.8f);
 	blueMat.Kd = glm::vec3(0.0f, 0.0f, 0.8f);
 	blueMat.Ks = glm::vec3(0.8f, 0.8f, 0.8f);
 	blueMat.Shininess = 16.0f;
 
-	esqueleto = new CASkeleton(vulkan, "body", glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	esqueleto->initialize(vulkan);
-	esqueleto->setLight(light);
-	esqueleto->setMaterial(blueMat);
+	CASkeleton* s = new CASkeleton(vulkan, "body", glm::vec3(position.x, 1.0f, position.y), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	s->setMaterial(blueMat);
+
+	Animation* a = new Animation(0.7f, s);
+	a->createAnimation();
+
+	CAGait* g = new CAGait(s, 1.4f);
+	g->setPhase(phase);
+
+	CARagdoll* r = new CARagdoll(s);
 
-	animacion = new Animation(0.7f, esqueleto);
-	animacion->createAnimation();
+	// El eje y local del cuello apunta hacia delante; se orienta hacia la cmara
+	miradas.push_back(s->addAimConstraint("neck", glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 10.0f), 1.0f));
+
+	esqueletos.push_back(s);
+	animaciones.push_back(a);
+	pasos.push_back(g);
+	ragdolls.push_back(r);
+	crowd->addAgent(s, a, g, position, glm::vec2(0.0f, 1.0f));
+	collisions->addSkeleton(s, 0.05f);
+	ragdollWorld->addRagdoll(r);
 }
 
 //
-// FUNCIN: CAScene::~CAScene()
+// FUNCIN: CAScene::spawnCharacter(CAVulkanState* vulkan)
 //
-// PROPSITO: Destruye el objeto que representa la escena
+// PROPSITO: Aade un personaje durante la ejecucin. Aparecen por turnos en una fila
+//            delante de la multitud inicial y la separacin los reparte.
 //
-CAScene::~CAScene()
+void CAScene::spawnCharacter(CAVulkanState* vulkan)
 {
-	delete ground;
-	delete esqueleto;
+	float x = -3.0f + 2.0f * (float)(spawned % (SCENE_CROWD_SIZE / 2));
+	addCharacter(vulkan, glm::vec2(x, 0.0f), (float)(spawned % SCENE_CROWD_SIZE) / (float)SCENE_CROWD_SIZE);
+	spawned++;
+}
+
+//
+// FUNCIN: CAScene::despawnCharacter()
+//
+// PROPSITO: Elimina el ltimo personaje aadido, aunque est en modo ragdoll. El
+//            primero se conserva. Su malla horneada se libera de forma diferida, as que no
+//            hay que esperar a los fotogramas en vuelo.
+//
+void CAScene::despawnCharacter()
+{
+	if (esqueletos.size() <= 1) return;
+
+	CASkeleton* s = esqueletos.back();
+	crowd->removeAgent(s);
+	collisions->removeSkeleton(s);
+	ragdollWorld->removeRagdoll(ragdolls.back());
+
+	// La animacin destruye su esqueleto
+	delete ragdolls.back();
+	delete pasos.back();
+	delete animaciones.back();
+
+	esqueletos.pop_back();
+	animaciones.pop_back();
+	pasos.pop_back();
+	ragdolls.pop_back();
+	miradas.pop_back();
 }
 
 //
-// FUNCIN: CAScene::finalize(CAVulkanState* vulkan)
+// FUNCIN: CAScene::setFixedTimestep(float step)
 //
-// PROPSITO: Destruyelos buffers de las figuras que forman la escena
+// PROPSITO: Hace que cada fotograma avance la simulacin step segundos en lugar del
+//            tiempo real transcurrido, para que una ejecucin sea reproducible.
+//            Con 0 se vuelve a usar el reloj.
 //
-void CAScene::finalize(CAVulkanState* vulkan)
+void CAScene::setFixedTimestep(float step)
 {
-	ground->finalize(vulkan);
-	esqueleto->finalize(vulkan);
+	fixedTimestep = step;
 }
 
 //
-// FUNCIN: CAScene::addCommands(VkCommandBuffer commandBuffer, int index)
+// FUNCIN: CAScene::~CAScene()
 //
-// PROPSITO: Aade los comandos de renderizado al command buffer
+// PROPSITO: Destruye el objeto que representa la escena
 //
-void CAScene::addCommands(CAVulkanState* vulkan, VkCommandBuffer commandBuffer, int index)
+CAScene::~CAScene()
 {
-	ground->addCommands(vulkan, commandBuffer, index);
-	esqueleto->addCommands(vulkan, commandBuffer, index);
+	delete crowd;
+	delete collisions;
+	delete ragdollWorld;
+	delete ground;
+	delete jointBatch;
+	delete boneBatch;
+	for (size_t i = 0; i < esqueletos.size(); i++)
+	{
+		delete ragdolls[i];
+		delete pasos[i];
+		delete esqueletos[i];
+	}
 }
 
 //
@@ -85,16 +175,60 @@ void CAScene::addCommands(CAVulkanState* vulkan, VkCommandBuffer commandBuffer,
 //
 void CAScene::update(CAVulkanState* vulkan, glm::mat4 view, glm::mat4 projection)
 {
-	this->duration += this->incremento;
-	glm::vec3 move = glm::vec3(0.0f, 0.0f, this->incremento);
-	animacion->animation(this->duration);
-	esqueleto->translate(move);
-	ground->updateUniformBuffers(vulkan, view, projection);
-	esqueleto->updateUniformBuffers(vulkan, view, projection);
-	if (6.00f < this->duration) {
-		this->duration = 0.0f;
-		esqueleto->translate(glm::vec3(0.0f, 0.0f, -5.6f));
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	frameTime = std::chrono::duration<float>(now - lastUpdate).count();
+	lastUpdate = now;
+	if (fixedTimestep > 0.0f) frameTime = fixedTimestep;
+
+	// El incremento por fotograma (avance de la animacin) acta como escala de tiempo
+	crowd->setTimeScale(std::max(0.0f, this->incremento / 0.02f));
+	crowd->step(frameTime);
+
+	// El mundo de ragdolls avanza siempre; slo simula los activos, cada uno en su isla
+	ragdollWorld->step(frameTime);
+
+	// Restricciones y jerarqua de cada personaje (salvo los que simula el ragdoll)
+	glm::vec3 camera = glm::vec3(glm::inverse(view)[3]);
+	jobs->parallelFor(esqueletos.size(), [this, camera](size_t i, uint32_t worker) {
+		if (ragdolls[i]->isActive()) return;
+		esqueletos[i]->setConstraintPoint(miradas[i], camera);
+		esqueletos[i]->resolve();
+	});
+	collisions->update();
+
+	// Cmara y luz se suben una vez por fotograma; la luz ya en coordenadas de vista
+	CASceneInfo sceneInfo;
+	sceneInfo.ViewMatrix = view;
+	sceneInfo.ProjectionMatrix = projection;
+	sceneInfo.Light = light;
+	sceneInfo.Light.Ldir = glm::mat3(view) * light.Ldir;
+	vulkan->updateSceneUniform(sceneInfo);
+
+	// Lista de dibujo: el suelo y, para los personajes, un dibujo por lote o un
+	// dibujo por personaje con su paleta de matrices
+	ground->addDraws(vulkan);
+
+	if (skinned)
+	{
+		for (size_t i = 0; i < esqueletos.size(); i++)
+		{
+			if (!esqueletos[i]->isBaked())
+			{
+				esqueletos[i]->bake(vulkan, jointBatch->getFigure(), boneBatch->getFigure());
+			}
+			esqueletos[i]->addDraws(vulkan);
+		}
+		return;
+	}
+
+	jointBatch->clear();
+	boneBatch->clear();
+	for (size_t i = 0; i < esqueletos.size(); i++)
+	{
+		esqueletos[i]->addInstances(jointBatch, boneBatch);
 	}
+	jointBatch->addDraws(vulkan);
+	boneBatch->addDraws(vulkan);
 }
 
 Animation* CAScene::getAnimation()
@@ -105,6 +239,7 @@ Animation* CAScene::getAnimation()
 void CAScene::setDuration(float d)
 {
 	this->duration = d;
+	crowd->setClipTime(d);
 }
 
 void CAScene::setMovement(float m)
@@ -117,4 +252,67 @@ void CAScene::setIncremento(float i)
 	this->incremento = i;
 }
 
+//
+// FUNCIN: CAScene::toggleRagdoll(int character)
+//
+// PROPSITO: Activa o desactiva el modo ragdoll del personaje indicado. Al activarlo se
+//            conserva la velocidad con la que avanzaba y deja de guiarlo la multitud.
+//
+void CAScene::toggleRagdoll(int character)
+{
+	if (character < 0 || character >= (int)ragdolls.size()) return;
+
+	CARagdoll* r = ragdolls[character];
+	if (r->isActive())
+	{
+		r->deactivate();
+		crowd->setEnabled(character, true);
+		return;
+	}
+
+	glm::vec2 velocity = crowd->getAgents()[character].velocity;
+	crowd->setEnabled(character, false);
+	r->activate(glm::vec3(velocity.x, 0.0f, velocity.y));
+}
+
+//
+// FUNCIN: CAScene::getCharacterCount()
+//
+// PROPSITO: Obtiene el nmero de personajes de la escena
+//
+int CAScene::getCharacterCount()
+{
+	return (int)esqueletos.size();
+}
+
+//
+// FUNCIN: CAScene::getCollisions()
+//
+// PROPSITO: Obtiene el mundo de colisiones de la escena (contactos con el suelo y
+//            solapamientos entre personajes)
+//
+CACollisionWorld* CAScene::getCollisions()
+{
+	return collisions;
+}
+
+//
+// FUNCIN: CAScene::toggleGait()
+//
+// PROPSITO: Alterna entre el andar procedural y el clip de andar con keyframes
+//
+void CAScene::toggleGait()
+{
+	crowd->setProceduralGait(!crowd->isProceduralGait());
+}
 
+//
+// FUNCIN: CAScene::toggleSkinned()
+//
+// PROPSITO: Alterna entre los lotes de piezas y un dibujo por personaje con paleta
+//            de matrices
+//
+void CAScene::toggleSkinned()
+{
+	skinned = !skinned;
+}
@@ -5,26 +5,59 @@
 #include "CABalljoint.h"
 #include "CASkeleton.h"
 #include "Animation.h"
+#include "CAJobSystem.h"
+#include "CARagdoll.h"
+#include "CACollision.h"
+#include "CACrowd.h"
+#include "CALight.h"
+#include "CAInstanceBatch.h"
+#include <vector>
+#include <chrono>
 
 class CAScene {
 public:
-	CAScene(CAVulkanState* vulkan);
+	CAScene(CAVulkanState* vulkan, CAJobSystem* jobs);
 	~CAScene();
-	void finalize(CAVulkanState* vulkan);
-	void addCommands(CAVulkanState* vulkan, VkCommandBuffer commandBuffer, int index);
 	void update(CAVulkanState* vulkan, glm::mat4 view, glm::mat4 projection);
 	Animation* getAnimation();
 	void setDuration(float d);
 	void setMovement(float m);
 	void setIncremento(float i);
+	void toggleRagdoll(int character);
+	int getCharacterCount();
+	void toggleGait();
+	void toggleSkinned();
+	void spawnCharacter(CAVulkanState* vulkan);
+	void despawnCharacter();
+	void setFixedTimestep(float step);
+	CACollisionWorld* getCollisions();
 	
 
 private:
 	float duration = 0.0f;
 	float movement = 0.0f;
 	float incremento = 0.02f;
+	CALight light;
 	CAFigure* ground;
+	CAInstanceBatch* jointBatch;
+	CAInstanceBatch* boneBatch;
+	bool skinned = false;
 	CASkeleton* esqueleto;
 	Animation* animacion;
+	std::vector<CASkeleton*> esqueletos;
+	std::vector<Animation*> animaciones;
+	std::vector<CAGait*> pasos;
+	CACrowd* crowd;
+	std::vector<int> miradas;
+	CAJobSystem* jobs;
+	std::vector<CARagdoll*> ragdolls;
+	CARagdollWorld* ragdollWorld;
+	CACollisionWorld* collisions;
+	int spawned = 0;
+	float frameTime = 0.0f;
+	float fixedTimestep = 0.0f;
+	std::chrono::steady_clock::time_point lastUpdate;
+
+	void addCharacter(CAVulkanState* vulkan, glm::vec2 position, float phase);
 };
 
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "CALight.h"
+
+typedef struct
+{
+	alignas(16) glm::mat4 ViewMatrix;
+	alignas(16) glm::mat4 ProjectionMatrix;
+	alignas(16) CALight Light;	// Ldir en coordenadas de vista
+} CASceneInfo;
@@ -3,6 +3,9 @@
 #include "CABalljoint.h"
 #include "CASkeleton.h"
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
 
 CASkeleton::CASkeleton(CAVulkanState* vulkan, std::string name, glm::vec3 offset_p, glm::vec3 eje_z, glm::vec3 eje_y){
     offset = offset_p;
@@ -11,6 +14,7 @@ CASkeleton::CASkeleton(CAVulkanState* vulkan, std::string name, glm::vec3 offset
     right = glm::normalize(glm::cross(up, dir));
     this->location = glm::mat4(glm::vec4(right, 0.0f), glm::vec4(up, 0.0f), glm::vec4(dir, 0.0f), glm::vec4(offset, 1.0f));
     this->name = name;
+    this->vulkan = vulkan;
 
     CABalljoint* pelvis = new CABalljoint("pelvis", 0.3f);
     pelvis->initialize(vulkan);
@@ -28,6 +32,9 @@ CASkeleton::CASkeleton(CAVulkanState* vulkan, std::string name, glm::vec3 offset
             spine->anadirHijo(neck);
             neck->setLocation(glm::vec3(0.0f, 0.0f, 0.0f));
             neck->setOrientation(glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            neck->setLimitX(-45.0f, 45.0f);
+            neck->setLimitY(-45.0f, 45.0f);
+            neck->setLimitZ(-60.0f, 60.0f);
 
             CABalljoint* clavicleL = new CABalljoint("clavicle_l", 0.25f);
             clavicleL->initialize(vulkan);
@@ -46,6 +53,9 @@ CASkeleton::CASkeleton(CAVulkanState* vulkan, std::string name, glm::vec3 offset
                     shoulderL->anadirHijo(elbowL);
                     elbowL->setLocation(glm::vec3(0.0f, 0.0f, 0.0f));
                     elbowL->setOrientation(glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+                    elbowL->setLimitX(0.0f, 150.0f);
+                    elbowL->setLimitY(0.0f, 0.0f);
+                    elbowL->setLimitZ(0.0f, 0.0f);
 
                         CABalljoint* wristL = new CABalljoint("wrist_l", 0.20f);
                         wristL->initialize(vulkan);
@@ -70,6 +80,9 @@ CASkeleton::CASkeleton(CAVulkanState* vulkan, std::string name, glm::vec3 offset
                     shoulderR->anadirHijo(elbowR);
                     elbowR->setLocation(glm::vec3(0.0f, 0.0f, 0.0f));
                     elbowR->setOrientation(glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+                    elbowR->setLimitX(0.0f, 150.0f);
+                    elbowR->setLimitY(0.0f, 0.0f);
+                    elbowR->setLimitZ(0.0f, 0.0f);
 
                         CABalljoint* wristR = new CABalljoint("wrist_r", 0.20f);
                         wristR->initialize(vulkan);
@@ -87,12 +100,18 @@ CASkeleton::CASkeleton(CAVulkanState* vulkan, std::string name, glm::vec3 offset
         hipL->anadirHijo(legL);
         legL->setLocation(glm::vec3(0.0f, 0.0f, 0.0f));
         legL->setOrientation(glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+        legL->setLimitX(-120.0f, 60.0f);
+        legL->setLimitY(-90.0f, 90.0f);
+        legL->setLimitZ(-30.0f, 30.0f);
 
             CABalljoint* kneeL = new CABalljoint("knee_l", 0.4f);
             kneeL->initialize(vulkan);
             legL->anadirHijo(kneeL);
             kneeL->setLocation(glm::vec3(0.0f, 0.0f, 0.0f));
             kneeL->setOrientation(glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            kneeL->setLimitX(0.0f, 150.0f);
+            kneeL->setLimitY(0.0f, 0.0f);
+            kneeL->setLimitZ(0.0f, 0.0f);
 
                 CABalljoint* ankleL = new CABalljoint("ankle_l", 0.25f);
                 ankleL->initialize(vulkan);
@@ -110,12 +129,18 @@ CASkeleton::CASkeleton(CAVulkanState* vulkan, std::string name, glm::vec3 offset
         hipR->anadirHijo(legR);
         legR->setLocation(glm::vec3(0.0f, 0.0f, 0.0f));
         legR->setOrientation(glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+        legR->setLimitX(-120.0f, 60.0f);
+        legR->setLimitY(-90.0f, 90.0f);
+        legR->setLimitZ(-30.0f, 30.0f);
 
             CABalljoint* kneeR = new CABalljoint("knee_r", 0.4f);
             kneeR->initialize(vulkan);
             legR->anadirHijo(kneeR);
             kneeR->setLocation(glm::vec3(0.0f, 0.0f, 0.0f));
             kneeR->setOrientation(glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            kneeR->setLimitX(0.0f, 150.0f);
+            kneeR->setLimitY(0.0f, 0.0f);
+            kneeR->setLimitZ(0.0f, 0.0f);
 
                 CABalljoint* ankleR = new CABalljoint("ankle_r", 0.25f);
                 ankleR->initialize(vulkan);
@@ -128,80 +153,135 @@ CASkeleton::CASkeleton(CAVulkanState* vulkan, std::string name, glm::vec3 offset
     this->articulaciones.push_back(hipR);
 
     for (int i = 0; i < articulaciones.size(); i++) {
-        articulaciones[i]->setParentLocation(location);
+        addJoints(articulaciones[i], -1);
     }
+    sortJoints();
+    resolve();
 }
 
+//
+// FUNCIN: CASkeleton::~CASkeleton()
+//
+// PROPSITO: Destruye el esqueleto y sus articulaciones. La malla horneada se libera
+//            de forma diferida, por lo que se puede destruir con fotogramas en vuelo.
+//
 CASkeleton::~CASkeleton() {
+    if (baked) vulkan->releaseMesh(bakedMesh);
+    for (size_t i = 0; i < joints.size(); i++) {
+        delete joints[i];
+    }
     articulaciones.clear();
 }
 
-
-void CASkeleton::initialize(CAVulkanState* vulkan) {
-    
-	size_t transformBufferSize = sizeof(CATransform);
-	vulkan->createUniformBuffer(transformBufferSize, &transformBuffer);
-
-	size_t lightBufferSize = sizeof(CALight);
-	vulkan->createUniformBuffer(lightBufferSize, &lightBuffer);
-
-	size_t materialBufferSize = sizeof(CAMaterial);
-	vulkan->createUniformBuffer(materialBufferSize, &materialBuffer);
-
-
-	CAUniformBuffer* buffers[] = { &transformBuffer, &lightBuffer, &materialBuffer };
-	size_t sizes[] = { transformBufferSize, lightBufferSize, materialBufferSize };
-
-	vulkan->createDescriptorSets(&descriptorPool, &descriptorSets, buffers, sizes, 3);
+//
+// FUNCIN: CASkeleton::addInstances(CAInstanceBatch* jointBatch, CAInstanceBatch* boneBatch)
+//
+// PROPSITO: Aade las piezas de todas las articulaciones a los lotes de instancias
+//
+void CASkeleton::addInstances(CAInstanceBatch* jointBatch, CAInstanceBatch* boneBatch)
+{
+	for (size_t i = 0; i < joints.size(); i++)
+	{
+		joints[i]->addInstances(jointBatch, boneBatch);
+	}
 }
 
-void CASkeleton::finalize(CAVulkanState* vulkan) {
-	for (int i = 0; i < articulaciones.size(); i++) {
-		articulaciones[i]->finalize(vulkan);
+//
+// FUNCIN: CASkeleton::bake(CAVulkanState* vulkan, CAFigure* jointShape, CAFigure* boneShape)
+//
+// PROPSITO: Hornea las esferas y los cilindros de todas las articulaciones en una sola
+//            malla. Los vrtices quedan en el espacio local de su articulacin (el
+//            cilindro ya escalado a la longitud del hueso) y guardan el ndice de la
+//            articulacin y el material, de modo que el personaje entero es un dibujo.
+//
+void CASkeleton::bake(CAVulkanState* vulkan, CAFigure* jointShape, CAFigure* boneShape)
+{
+	const std::vector<CAVertex>& jointVertices = jointShape->getVertices();
+	const std::vector<uint16_t>& jointIndices = jointShape->getIndices();
+	const std::vector<CAVertex>& boneVertices = boneShape->getVertices();
+	const std::vector<uint16_t>& boneIndices = boneShape->getIndices();
+
+	if (joints.size() * (jointVertices.size() + boneVertices.size()) > 65536)
+	{
+		throw std::runtime_error("failed to bake skeleton: too many vertices!");
 	}
 
-	vulkan->destroyUniformBuffer(transformBuffer);
-	vulkan->destroyUniformBuffer(lightBuffer);
-	vulkan->destroyUniformBuffer(materialBuffer);
-	vulkan->destroyDescriptorSets(descriptorPool, descriptorSets);
-}
+	std::vector<CAVertex> vertices;
+	std::vector<uint16_t> indices;
+	vertices.reserve(joints.size() * (jointVertices.size() + boneVertices.size()));
+	indices.reserve(joints.size() * (jointIndices.size() + boneIndices.size()));
 
-void CASkeleton::addCommands(CAVulkanState* vulkan, VkCommandBuffer commandBuffer, int index) {
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan->getPipelineLayout(), 0, 1, &descriptorSets[index], 0, nullptr);
-	for (int i = 0; i < articulaciones.size(); i++)
+	for (size_t j = 0; j < joints.size(); j++)
 	{
-		articulaciones[i]->addCommands(vulkan, commandBuffer, index);
+		uint16_t base = (uint16_t)vertices.size();
+		for (size_t v = 0; v < jointVertices.size(); v++)
+		{
+			CAVertex vertex = jointVertices[v];
+			vertex.joint = (uint32_t)j;
+			vertex.material = joints[j]->getJointMaterial();
+			vertices.push_back(vertex);
+		}
+		for (size_t i = 0; i < jointIndices.size(); i++)
+		{
+			indices.push_back(base + jointIndices[i]);
+		}
+
+		// El cilindro comn mide 2 de largo: se coloca y escala como en addInstances
+		float length = joints[j]->getLength();
+		glm::mat4 boneMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, length / 2));
+		boneMatrix = glm::scale(boneMatrix, glm::vec3(1.0f, 1.0f, length / 2));
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(boneMatrix)));
+
+		base = (uint16_t)vertices.size();
+		for (size_t v = 0; v < boneVertices.size(); v++)
+		{
+			CAVertex vertex = boneVertices[v];
+			vertex.pos = glm::vec3(boneMatrix * glm::vec4(vertex.pos, 1.0f));
+			vertex.norm = glm::normalize(normalMatrix * vertex.norm);
+			vertex.joint = (uint32_t)j;
+			vertex.material = joints[j]->getBoneMaterial();
+			vertices.push_back(vertex);
+		}
+		for (size_t i = 0; i < boneIndices.size(); i++)
+		{
+			indices.push_back(base + boneIndices[i]);
+		}
 	}
+
+	bakedMesh = vulkan->createMesh(vertices, indices);
+	palette.resize(joints.size());
+	baked = true;
 }
 
-void CASkeleton::updateUniformBuffers(CAVulkanState* vulkan, glm::mat4 view, glm::mat4 projection)
+//
+// FUNCIN: CASkeleton::isBaked()
+//
+// PROPSITO: Indica si el esqueleto ya tiene su malla horneada
+//
+bool CASkeleton::isBaked()
 {
-	CATransform transform;
-	transform.MVP = projection * view * location;
-	transform.ModelViewMatrix = view * location;
-	transform.ViewMatrix = view;
-
-	vulkan->updateUniformBuffer(sizeof(CATransform), &transform, transformBuffer);
-	vulkan->updateUniformBuffer(sizeof(CALight), &light, lightBuffer);
-	vulkan->updateUniformBuffer(sizeof(CAMaterial), &material, materialBuffer);
-
-	for (int i = 0; i < articulaciones.size(); i++)
-	{
-		articulaciones[i]->updateUniformBuffers(vulkan, view, projection);
-	}
+	return baked;
 }
 
 //
-// FUNCIN: CAFigure::setLight(CALight l)
+// FUNCIN: CASkeleton::addDraws(CAVulkanState* vulkan)
 //
-// PROPSITO: Asigna las propiedades de la luz que incide en la figura
+// PROPSITO: Sube la paleta de matrices del fotograma y aade el nico dibujo de la
+//            malla horneada. La instancia slo aporta PaletteBase.
 //
-void CASkeleton::setLight(CALight l)
+void CASkeleton::addDraws(CAVulkanState* vulkan)
 {
-	this->light = l;
-    for (int i = 0; i < articulaciones.size(); i++){
-        articulaciones[i]->setLight(l);
-    }
+	for (size_t i = 0; i < joints.size(); i++)
+	{
+		palette[i] = joints[i]->getMatrix();
+	}
+
+	CAInstance instance = {};
+	instance.ModelMatrix = glm::mat4(1.0f);
+	instance.MaterialIndex = 0;
+	instance.PaletteBase = vulkan->addPalette(palette);
+
+	vulkan->addDraw(bakedMesh, &instance, 1);
 }
 
 //
@@ -226,10 +306,6 @@ std::vector<CABalljoint*> CASkeleton::getHijas()
 //
 void CASkeleton::resetLocation(){
 	location = glm::mat4(1.0f);
-
-    for (int i = 0; i < articulaciones.size(); i++) {
-        articulaciones[i]->setParentLocation(location);
-    }
 }
 
 //
@@ -239,9 +315,15 @@ void CASkeleton::resetLocation(){
 //
 void CASkeleton::setLocation(glm::mat4 m){
 	location = glm::mat4(m);
-    for (int i = 0; i < articulaciones.size(); i++) {
-        articulaciones[i]->setParentLocation(location);
-    }
+}
+
+//
+// FUNCIN: CASkeleton::getLocation()
+//
+// PROPSITO: Obtiene la matriz de localizacin (Model).
+//
+glm::mat4 CASkeleton::getLocation(){
+    return location;
 }
 
 
@@ -252,9 +334,6 @@ void CASkeleton::setLocation(glm::mat4 m){
 //
 void CASkeleton::translate(glm::vec3 t){
 	location = glm::translate(location, t);
-    for (int i = 0; i < articulaciones.size(); i++) {
-        articulaciones[i]->setParentLocation(location);
-    }
 }
 
 //
@@ -265,8 +344,282 @@ void CASkeleton::translate(glm::vec3 t){
 void CASkeleton::rotate(float angle, glm::vec3 axis)
 {
 	location = glm::rotate(location, glm::radians(angle), axis);
-    for (int i = 0; i < articulaciones.size(); i++) {
-        articulaciones[i]->setParentLocation(location);
-    }
 }
 
+//
+// FUNCIN: aimMatrix(glm::mat4 m, glm::mat3 rest, glm::vec3 axis, glm::vec3 point, glm::vec3 minAngle, glm::vec3 maxAngle, float weight)
+//
+// PROPSITO: Gira la matriz m sobre su origen para que su eje local axis apunte hacia
+//            point. El giro se expresa como pose (Z * Y * X) respecto a la orientacin
+//            de reposo rest, ya en el sistema del padre, y cada ngulo se limita por
+//            separado entre minAngle y maxAngle (radianes), como en CARagdoll::apply
+//
+static glm::mat4 aimMatrix(glm::mat4 m, glm::mat3 rest, glm::vec3 axis, glm::vec3 point, glm::vec3 minAngle, glm::vec3 maxAngle, float weight)
+{
+	glm::vec3 origin = glm::vec3(m[3]);
+	glm::vec3 target = point - origin;
+	if (glm::length(target) < 1e-6f) return m;
+
+	glm::vec3 from = glm::normalize(glm::vec3(m * glm::vec4(axis, 0.0f)));
+	glm::vec3 to = glm::normalize(target);
+	glm::vec3 rotAxis = glm::cross(from, to);
+	if (glm::length(rotAxis) < 1e-6f) return m;
+
+	float angle = (float)acos(glm::clamp(glm::dot(from, to), -1.0f, 1.0f));
+	glm::mat3 aimed = glm::mat3(glm::rotate(glm::mat4(1.0f), angle, glm::normalize(rotAxis))) * glm::mat3(m);
+
+	// El peso interpola entre la pose de partida y la que apunta al objetivo por el
+	// camino ms corto en cada eje
+	glm::vec3 current = CABalljoint::poseAngles(glm::transpose(rest) * glm::mat3(m));
+	glm::vec3 delta = CABalljoint::poseAngles(glm::transpose(rest) * aimed) - current;
+	for (int i = 0; i < 3; i++)
+	{
+		if (delta[i] > glm::pi<float>()) delta[i] -= 2.0f * glm::pi<float>();
+		if (delta[i] < -glm::pi<float>()) delta[i] += 2.0f * glm::pi<float>();
+	}
+	glm::vec3 pose = glm::clamp(current + delta * weight, minAngle, maxAngle);
+
+	glm::mat3 r = rest * CABalljoint::poseRotation(pose);
+	return glm::mat4(glm::vec4(r[0], 0.0f), glm::vec4(r[1], 0.0f), glm::vec4(r[2], 0.0f), glm::vec4(origin, 1.0f));
+}
+
+//
+// FUNCIN: blendMatrix(glm::mat4 a, glm::mat4 b, float weight, bool position)
+//
+// PROPSITO: Interpola la orientacin (y opcionalmente la posicin) de a hacia b y
+//            vuelve a ortonormalizar los ejes
+//
+static glm::mat4 blendMatrix(glm::mat4 a, glm::mat4 b, float weight, bool position)
+{
+	glm::vec3 y = glm::vec3(a[1]) + (glm::vec3(b[1]) - glm::vec3(a[1])) * weight;
+	glm::vec3 z = glm::vec3(a[2]) + (glm::vec3(b[2]) - glm::vec3(a[2])) * weight;
+	z = glm::normalize(z);
+	glm::vec3 x = glm::normalize(glm::cross(y, z));
+	y = glm::cross(z, x);
+
+	glm::vec4 origin = position ? a[3] + (b[3] - a[3]) * weight : a[3];
+	return glm::mat4(glm::vec4(x, 0.0f), glm::vec4(y, 0.0f), glm::vec4(z, 0.0f), origin);
+}
+
+//
+// FUNCIN: CASkeleton::addJoints(CABalljoint* joint, int parent)
+//
+// PROPSITO: Aplana la jerarqua en profundidad guardando el ndice del padre
+//
+void CASkeleton::addJoints(CABalljoint* joint, int parent)
+{
+	int index = (int)joints.size();
+	joints.push_back(joint);
+	parents.push_back(parent);
+
+	std::vector<CABalljoint*> hijas = joint->getHijas();
+	for (size_t i = 0; i < hijas.size(); i++) {
+		addJoints(hijas[i], index);
+	}
+}
+
+//
+// FUNCIN: CASkeleton::findJoint(std::string name)
+//
+// PROPSITO: Obtiene el ndice de la articulacin con ese nombre
+//
+int CASkeleton::findJoint(std::string name)
+{
+	for (size_t i = 0; i < joints.size(); i++) {
+		if (joints[i]->getName() == name) return (int)i;
+	}
+	throw std::runtime_error("failed to find joint " + name + "!");
+}
+
+//
+// FUNCIN: CASkeleton::addConstraint(CAConstraintType type, int joint, int target, float weight)
+//
+// PROPSITO: Aade una restriccin a los arrays y recalcula el orden de evaluacin
+//
+int CASkeleton::addConstraint(CAConstraintType type, int joint, int target, float weight)
+{
+	glm::mat2x3 limit = joints[joint]->getLimit();
+
+	constraintType.push_back(type);
+	constraintJoint.push_back(joint);
+	constraintTarget.push_back(target);
+	constraintAxis.push_back(glm::vec3(0.0f, 0.0f, 1.0f));
+	constraintPoint.push_back(glm::vec3(0.0f, 0.0f, 0.0f));
+	constraintWeight.push_back(weight);
+	constraintMinAngle.push_back(glm::radians(limit[0]));
+	constraintMaxAngle.push_back(glm::radians(limit[1]));
+	constraintOffset.push_back(glm::mat4(1.0f));
+	sortJoints();
+	return (int)constraintType.size() - 1;
+}
+
+//
+// FUNCIN: CASkeleton::addAimConstraint(std::string joint, glm::vec3 axis, glm::vec3 point, float weight)
+//
+// PROPSITO: Orienta el eje local axis de la articulacin hacia un punto del mundo
+//            (p.ej. el cuello hacia la cmara), dentro de los lmites de la articulacin
+//
+int CASkeleton::addAimConstraint(std::string joint, glm::vec3 axis, glm::vec3 point, float weight)
+{
+	int c = addConstraint(CA_CONSTRAINT_AIM, findJoint(joint), -1, weight);
+	constraintAxis[c] = glm::normalize(axis);
+	constraintPoint[c] = point;
+	return c;
+}
+
+//
+// FUNCIN: CASkeleton::addAimConstraint(std::string joint, glm::vec3 axis, std::string target, float weight)
+//
+// PROPSITO: Orienta el eje local axis de la articulacin hacia otra articulacin
+//
+int CASkeleton::addAimConstraint(std::string joint, glm::vec3 axis, std::string target, float weight)
+{
+	int c = addConstraint(CA_CONSTRAINT_AIM, findJoint(joint), findJoint(target), weight);
+	constraintAxis[c] = glm::normalize(axis);
+	return c;
+}
+
+//
+// FUNCIN: CASkeleton::addOrientConstraint(std::string joint, std::string target, float weight)
+//
+// PROPSITO: Copia la orientacin de otra articulacin conservando la posicin
+//
+int CASkeleton::addOrientConstraint(std::string joint, std::string target, float weight)
+{
+	return addConstraint(CA_CONSTRAINT_ORIENT, findJoint(joint), findJoint(target), weight);
+}
+
+//
+// FUNCIN: CASkeleton::addParentConstraint(std::string joint, std::string target, float weight)
+//
+// PROPSITO: Hace que la articulacin siga a otra como si fuera su padre, manteniendo
+//            la posicin relativa que tienen en la pose actual
+//
+int CASkeleton::addParentConstraint(std::string joint, std::string target, float weight)
+{
+	int j = findJoint(joint);
+	int t = findJoint(target);
+	int c = addConstraint(CA_CONSTRAINT_PARENT, j, t, weight);
+	constraintOffset[c] = glm::inverse(world[t]) * world[j];
+	return c;
+}
+
+//
+// FUNCIN: CASkeleton::setConstraintPoint(int constraint, glm::vec3 point)
+//
+// PROPSITO: Cambia el punto objetivo de una restriccin de orientacin (aim)
+//
+void CASkeleton::setConstraintPoint(int constraint, glm::vec3 point)
+{
+	constraintPoint[constraint] = point;
+}
+
+//
+// FUNCIN: CASkeleton::setConstraintWeight(int constraint, float weight)
+//
+// PROPSITO: Cambia el peso (0 desactiva, 1 aplica por completo) de una restriccin
+//
+void CASkeleton::setConstraintWeight(int constraint, float weight)
+{
+	constraintWeight[constraint] = weight;
+}
+
+//
+// FUNCIN: CASkeleton::sortJoints()
+//
+// PROPSITO: Calcula el orden de evaluacin (ordenacin topolgica) en el que cada
+//            articulacin va despus de su padre y de los objetivos de sus restricciones,
+//            y agrupa las restricciones por articulacin
+//
+void CASkeleton::sortJoints()
+{
+	size_t n = joints.size();
+	std::vector<std::vector<int>> next(n);
+	std::vector<int> pending(n, 0);
+
+	for (size_t i = 0; i < n; i++) {
+		if (parents[i] >= 0) {
+			next[parents[i]].push_back((int)i);
+			pending[i]++;
+		}
+	}
+	for (size_t c = 0; c < constraintJoint.size(); c++) {
+		if (constraintTarget[c] >= 0) {
+			next[constraintTarget[c]].push_back(constraintJoint[c]);
+			pending[constraintJoint[c]]++;
+		}
+	}
+
+	order.clear();
+	for (size_t i = 0; i < n; i++) {
+		if (pending[i] == 0) order.push_back((int)i);
+	}
+	for (size_t k = 0; k < order.size(); k++) {
+		int j = order[k];
+		for (size_t e = 0; e < next[j].size(); e++) {
+			if (--pending[next[j][e]] == 0) order.push_back(next[j][e]);
+		}
+	}
+	if (order.size() != n) {
+		throw std::runtime_error("failed to sort joint constraints (cycle)!");
+	}
+
+	constraintStart.assign(n + 1, 0);
+	for (size_t c = 0; c < constraintJoint.size(); c++) {
+		constraintStart[constraintJoint[c] + 1]++;
+	}
+	for (size_t i = 0; i < n; i++) {
+		constraintStart[i + 1] += constraintStart[i];
+	}
+	constraintList.resize(constraintJoint.size());
+	std::vector<int> fill(constraintStart.begin(), constraintStart.end() - 1);
+	for (size_t c = 0; c < constraintJoint.size(); c++) {
+		constraintList[fill[constraintJoint[c]]++] = (int)c;
+	}
+
+	world.resize(n);
+}
+
+//
+// FUNCIN: CASkeleton::resolve()
+//
+// PROPSITO: Etapa de restricciones y resolucin de la jerarqua en una sola pasada.
+//            Se llama una vez por fotograma, despus de muestrear la animacin (los
+//            setters de CABalljoint solo guardan la pose). Cada articulacin se coloca
+//            en orden de dependencias aplicando sus restricciones antes de escribirla.
+//
+void CASkeleton::resolve()
+{
+	for (size_t k = 0; k < order.size(); k++) {
+		int j = order[k];
+		int p = parents[j];
+
+		glm::mat4 parent = location;
+		if (p >= 0) {
+			parent = glm::translate(world[p], glm::vec3(0.0f, 0.0f, joints[p]->getLength()));
+		}
+		glm::mat4 m = parent * joints[j]->getLocalMatrix();
+
+		for (int i = constraintStart[j]; i < constraintStart[j + 1]; i++) {
+			int c = constraintList[i];
+			float w = constraintWeight[c];
+			if (w <= 0.0f) continue;
+
+			int t = constraintTarget[c];
+			switch (constraintType[c]) {
+			case CA_CONSTRAINT_AIM:
+				m = aimMatrix(m, glm::mat3(parent) * joints[j]->getOrientation(), constraintAxis[c], (t >= 0) ? glm::vec3(world[t][3]) : constraintPoint[c], constraintMinAngle[c], constraintMaxAngle[c], w);
+				break;
+			case CA_CONSTRAINT_ORIENT:
+				m = blendMatrix(m, world[t], w, false);
+				break;
+			case CA_CONSTRAINT_PARENT:
+				m = blendMatrix(m, world[t] * constraintOffset[c], w, true);
+				break;
+			}
+		}
+
+		world[j] = m;
+		joints[j]->setMatrix(m);
+	}
+}
@@ -1,6 +1,18 @@
 #pragma once
 
 #include "CABalljoint.h"
+#include <vector>
+
+//
+// ENUMERACIN: CAConstraintType
+//
+// DESCRIPCIN: Tipos de restriccin que se aplican a una articulacin antes de colocarla
+//
+enum CAConstraintType {
+	CA_CONSTRAINT_AIM,
+	CA_CONSTRAINT_ORIENT,
+	CA_CONSTRAINT_PARENT
+};
 
 class CASkeleton {
 protected:
@@ -13,28 +25,62 @@ protected:
 	glm::vec3 right;
 	
 	std::vector<CABalljoint*> articulaciones;
-	CALight light;
 	CAMaterial material;
 
 public:
 	CASkeleton(CAVulkanState* vulkan, std::string name, glm::vec3 offset, glm::vec3 up, glm::vec3 dir);
 	~CASkeleton();
-	void initialize(CAVulkanState* vulkan);
-	void finalize(CAVulkanState* vulkan);
-	void addCommands(CAVulkanState* vulkan, VkCommandBuffer commandBuffer, int index);
-	void updateUniformBuffers(CAVulkanState* vulkan, glm::mat4 view, glm::mat4 projection);
+	void addInstances(CAInstanceBatch* jointBatch, CAInstanceBatch* boneBatch);
+	void bake(CAVulkanState* vulkan, CAFigure* jointShape, CAFigure* boneShape);
+	bool isBaked();
+	void addDraws(CAVulkanState* vulkan);
 	void resetLocation();
 	void setLocation(glm::mat4 m);
+	glm::mat4 getLocation();
 	void translate(glm::vec3 t);
 	void rotate(float angle, glm::vec3 axis);
-	void setLight(CALight l);
 	void setMaterial(CAMaterial m);
 	std::vector<CABalljoint*> getHijas();
+	int addAimConstraint(std::string joint, glm::vec3 axis, glm::vec3 point, float weight);
+	int addAimConstraint(std::string joint, glm::vec3 axis, std::string target, float weight);
+	int addOrientConstraint(std::string joint, std::string target, float weight);
+	int addParentConstraint(std::string joint, std::string target, float weight);
+	void setConstraintPoint(int constraint, glm::vec3 point);
+	void setConstraintWeight(int constraint, float weight);
+	void resolve();
 
 private:
-	CAUniformBuffer transformBuffer;
-	CAUniformBuffer lightBuffer;
-	CAUniformBuffer materialBuffer;
-	VkDescriptorPool descriptorPool;
-	std::vector<VkDescriptorSet> descriptorSets;
+	// Jerarqua aplanada: joints en orden de recorrido en profundidad y order con
+	// el orden de evaluacin (padres y objetivos de restricciones antes)
+	std::vector<CABalljoint*> joints;
+	std::vector<int> parents;
+	std::vector<int> order;
+	std::vector<glm::mat4> world;
+
+	// Malla horneada: todas las piezas en una sola malla, cada vrtice con el
+	// ndice de su articulacin en la paleta (palette, una matriz por joint).
+	// Se devuelve a los buffers comunes de vulkan al destruir el esqueleto.
+	CAVulkanState* vulkan;
+	bool baked = false;
+	CAMesh bakedMesh;
+	std::vector<glm::mat4> palette;
+
+	// Restricciones en arrays planos. constraintStart/constraintList agrupan los
+	// ndices de restriccin por articulacin (formato CSR).
+	std::vector<CAConstraintType> constraintType;
+	std::vector<int> constraintJoint;
+	std::vector<int> constraintTarget;
+	std::vector<glm::vec3> constraintAxis;
+	std::vector<glm::vec3> constraintPoint;
+	std::vector<float> constraintWeight;
+	std::vector<glm::vec3> constraintMinAngle;
+	std::vector<glm::vec3> constraintMaxAngle;
+	std::vector<glm::mat4> constraintOffset;
+	std::vector<int> constraintStart;
+	std::vector<int> constraintList;
+
+	void addJoints(CABalljoint* joint, int parent);
+	int findJoint(std::string name);
+	int addConstraint(CAConstraintType type, int joint, int target, float weight);
+	void sortJoints();
 };
\ No newline at end of file
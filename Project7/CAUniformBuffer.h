@@ -2,10 +2,10 @@
 
 #include <vulkan/vulkan.h>
 #include <vector>
+#include "CAAllocation.h"
 
 typedef struct
 {
 	std::vector<VkBuffer> buffers;
-	std::vector<VkDeviceMemory> memories;
+	std::vector<CAAllocation> memories;
 } CAUniformBuffer;
-
@@ -2,10 +2,20 @@
 
 #include <glm\common.hpp>
 #include <array>
+#include <cstdint>
 
+//
+// ESTRUCTURA: CAVertex
+//
+// DESCRIPCIN: Vrtice de las mallas. joint y material slo se usan en las mallas
+//              de esqueleto horneadas: indican la matriz de la paleta que mueve el
+//              vrtice y su material. En el resto de mallas valen 0.
+//
 struct CAVertex 
 {
 	glm::vec3 pos;
 	glm::vec3 norm;
+	uint32_t joint;
+	uint32_t material;
 };
 
@@ -1,10 +0,0 @@
-#pragma once
-
-#include <vulkan/vulkan.h>
-
-typedef struct
-{
-	VkBuffer buffer;
-	VkDeviceMemory memory;
-} CAVertexBuffer;
-
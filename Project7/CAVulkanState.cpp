@@ -2,13 +2,57 @@
 
 #include "CAModel.h"
 #include "CAVertex.h"
-#include "CATransform.h"
 #include "resource.h"
+#define NOMINMAX
 #include <windows.h>
 #include <glm/common.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <thread>
 #include <vector>
 
+// Tamao inicial del anillo de staging y alineacin de cada copia dentro de l
+#define STAGING_RING_SIZE (4 * 1024 * 1024)
+#define STAGING_ALIGNMENT 16
+// Capacidad inicial de los buffers comunes de geometra (vrtices e ndices)
+#define GEOMETRY_VERTEX_CAPACITY 65536
+#define GEOMETRY_INDEX_CAPACITY (3 * 65536)
+// Capacidad inicial de la lista de dibujo de cada fotograma (dibujos e instancias)
+#define DRAW_LIST_SIZE 64
+#define DRAW_INSTANCE_SIZE 1024
+#define DRAW_PALETTE_SIZE 512
+// Nmero inicial de materiales en la tabla
+#define MATERIAL_TABLE_SIZE 64
+// Fichero de la cach de pipelines y marca de su cabecera ("CAPC")
+#define PIPELINE_CACHE_FILE "pipeline.cache"
+#define PIPELINE_CACHE_MAGIC 0x43504143
+
+//
+// ESTRUCTURA: CAPipelineCacheHeader
+//
+// DESCRIPCIN: Cabecera del fichero de la cach de pipelines. Los datos slo se
+//              reutilizan con el mismo dispositivo, driver y UUID de cach.
+//
+typedef struct
+{
+	uint32_t magic;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t dataSize;
+} CAPipelineCacheHeader;
+
+// Peso de la ltima medida en la media del tiempo de CPU de un fotograma y
+// periodo del informe de latencia (segundos)
+#define FRAME_TIME_SMOOTHING 0.1
+#define LATENCY_REPORT_PERIOD 1.0
+
+// Dibujos de cada particin de la lista que se graba en un command buffer secundario
+#define DRAWS_PER_PARTITION 16u
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 /////                                                                                 /////
 /////                              Mtodos pblicos                                   /////
@@ -16,28 +60,83 @@
 ///////////////////////////////////////////////////////////////////////////////////////////
 
 //
-// FUNCIN: CAVulkanState::CAVulkanState(GLFWwindow* window)
+// FUNCIN: CAVulkanState::CAVulkanState(GLFWwindow* window, const CAPresentSettings& settings)
 //
 // PROPSITO: Crea el estado de Vulkan
 //
-CAVulkanState::CAVulkanState(GLFWwindow* window)
+CAVulkanState::CAVulkanState(GLFWwindow* window, const CAPresentSettings& settings)
 {
 	glfwGetFramebufferSize(window, &wWidth, &wHeight);
 	this->window = window;
+	this->headless = false;
+	initialize(settings);
+}
+
+//
+// FUNCIN: CAVulkanState::CAVulkanState(int width, int height, const CAPresentSettings& settings)
+//
+// PROPSITO: Crea el estado de Vulkan sin ventana ni superficie. Se genera sobre
+//            imgenes propias del tamao indicado con el mismo render pass y
+//            pipeline, y no se presenta nada (modo de medida de rendimiento).
+//
+CAVulkanState::CAVulkanState(int width, int height, const CAPresentSettings& settings)
+{
+	this->wWidth = width;
+	this->wHeight = height;
+	this->window = nullptr;
+	this->headless = true;
+	initialize(settings);
+}
+
+//
+// FUNCIN: CAVulkanState::initialize(const CAPresentSettings& settings)
+//
+// PROPSITO: Inicializacin comn a los dos constructores
+//
+void CAVulkanState::initialize(const CAPresentSettings& settings)
+{
+	this->settings = settings;
+	if (this->settings.framesInFlight == 0) this->settings.framesInFlight = 1;
+	this->frameCount = this->settings.framesInFlight;
+	this->slotReady = false;
+	this->inputPending = false;
+	this->frameHasInput = false;
+	this->cpuFrameTime = std::chrono::steady_clock::duration::zero();
+	this->nextFrameDeadline = std::chrono::steady_clock::now();
+	this->lastLatencyReport = std::chrono::steady_clock::now();
+	this->latencyStats = {};
+	this->model = nullptr;
+	this->jobs = nullptr;
+	this->recordGeneration = 1;
+	this->surface = VK_NULL_HANDLE;
+	this->swapChain = VK_NULL_HANDLE;
+	this->submittedValue = 0;
+	this->completedValue = 0;
+	this->recordingFrame = false;
 	createInstance();
-	createSurface(window);
+	if (!headless) createSurface(window);
 	pickPhysicalDevice();
 	createLogicalDevice();
-	createSwapChain();
+	createPipelineCache();
+	createTimeline();
+	allocator = new CAMemoryAllocator(device, physicalDevice);
+	if (headless) createOffscreenImages();
+	else createSwapChain();
 	createImageViews();
 	createRenderPass();
 	createPipelineLayout();
 	createGraphicsPipeline();
-	createDepthBuffers();
+	createDepthBuffer();
 	createFramebuffers();
 	createCommandPool();
 	createCommandBuffers();
 	createSyncObjects();
+	createStagingRing();
+	createDescriptorAllocators();
+	createGeometryArena(GEOMETRY_VERTEX_CAPACITY, GEOMETRY_INDEX_CAPACITY);
+	createDrawList(DRAW_LIST_SIZE, DRAW_INSTANCE_SIZE, DRAW_PALETTE_SIZE);
+	createSceneUniform();
+	createMaterialTable(MATERIAL_TABLE_SIZE);
 }
 
 //
@@ -47,27 +146,35 @@ CAVulkanState::CAVulkanState(GLFWwindow* window)
 //
 CAVulkanState::~CAVulkanState()
 {
-	for (size_t i = 0; i < frameCount; i++)
-	{
-		vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-		vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-		vkDestroyFence(device, inFlightFences[i], nullptr);
-	}
-	vkFreeCommandBuffers(device, commandPool, imageCount, commandBuffers.data());
+	vkDeviceWaitIdle(device);
+	deletionQueue.flush();
+	collectRetiredSwapChains(true);
+	destroyStagingRing();
+	destroyGeometryArena();
+	destroyDrawList();
+	destroySceneUniform();
+	destroyMaterialTable();
+	deletionQueue.flush();
+	destroyDescriptorAllocators();
+	destroySyncObjects();
+	destroyRecordPools();
+	vkFreeCommandBuffers(device, commandPool, frameCount, commandBuffers.data());
 	vkDestroyCommandPool(device, commandPool, nullptr);
+	destroyDepthBuffer();
 	for (uint32_t i = 0; i < imageCount; i++)
 	{
-		vkDestroyImageView(device, depthImageViews[i], nullptr);
-		vkFreeMemory(device, depthImageMemories[i], nullptr);
-		vkDestroyImage(device, depthImages[i], nullptr);
 		vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
 		vkDestroyImageView(device, swapChainImageViews[i], nullptr);
 	}
 	vkDestroyPipeline(device, graphicsPipeline, nullptr);
 	vkDestroyRenderPass(device, renderPass, nullptr);
-	vkDestroySwapchainKHR(device, swapChain, nullptr);
+	if (headless) destroyOffscreenImages();
+	else vkDestroySwapchainKHR(device, swapChain, nullptr);
+	destroyPipelineCache();
+	destroyTimeline();
+	delete allocator;
 	vkDestroyDevice(device, nullptr);
-	vkDestroySurfaceKHR(instance, surface, nullptr);
+	if (surface != VK_NULL_HANDLE) vkDestroySurfaceKHR(instance, surface, nullptr);
 	vkDestroyInstance(instance, nullptr);
 }
 
@@ -87,14 +194,18 @@ void CAVulkanState::windowResized(int width, int height)
 //
 // FUNCIN: CAVulkanState::setModel(CAModel* model)
 //
-// PROPSITO: Asigna el modelo
+// PROPSITO: Asigna el modelo. Sus hilos de trabajo se usan tambin para grabar los
+//            command buffers de cada fotograma.
 //
 void CAVulkanState::setModel(CAModel* model)
 {
 	this->model = model;
+	this->jobs = model->getJobSystem();
 	double aspect = (double)wWidth / (double)wHeight;
 	this->model->aspect_ratio(aspect);
-	fillCommandBuffers();
+	createRecordPools();
+	uploadMaterials();
+	flushUploads();
 }
 
 //
@@ -104,280 +215,562 @@ void CAVulkanState::setModel(CAModel* model)
 //
 void CAVulkanState::draw()
 {
+	if (!slotReady) waitForFrameSlot();
+	slotReady = false;
+
+	// La entrada recibida hasta aqu es la que refleja este fotograma
+	frameHasInput = inputPending;
+	frameInputTime = inputTime;
+	inputPending = false;
+
+	recordingFrame = true;
 	waitForNextImage();
+	drawCommands.clear();
+	drawInstances.clear();
+	drawPalette.clear();
 	model->update();
+	uploadDraws();
+	uploadMaterials();
+	flushMappedRanges();
+	flushUploads();
+	updateFrameDescriptorSets();
+	recordCommandBuffer((uint32_t)currentFrame, currentImage);
 	submitGraphicsCommands();
+
+	// Lo liberado mientras se preparaba el fotograma puede usarlo el propio fotograma
+	recordingFrame = false;
+	for (size_t i = 0; i < frameDestroys.size(); i++)
+	{
+		deletionQueue.push(submittedValue, frameDestroys[i]);
+	}
+	frameDestroys.clear();
+
 	submitPresentCommands();
 }
 
-///////////////////////////////////////////////////////////////////////////////////////////
-/////                                                                                 /////
-/////                    Mtodos pblicos de gestin de buffers                       /////
-/////                                                                                 /////
-///////////////////////////////////////////////////////////////////////////////////////////
- 
 //
-// FUNCIN: CAVulkanState::createVertexBuffer(size_t vertexSize, void * vertexData, CAVertexBuffer* vbo)
+// FUNCIN: CAVulkanState::finish()
+//
+// PROPSITO: Espera a que la GPU termine todos los fotogramas enviados. Sin ventana
+//            es lo que permite medir el tiempo real de generacin.
+//
+void CAVulkanState::finish()
+{
+	waitForValue(submittedValue);
+	deletionQueue.collect(completedValue);
+}
+
+//
+// FUNCIN: CAVulkanState::saveImage(const char* path)
 //
-// PROPSITO: Crea un Vertex Buffer
+// PROPSITO: Sin ventana, copia la ltima imagen generada a un buffer visible desde
+//            el host y la guarda como PPM binario (P6). La imagen queda en
+//            TRANSFER_SRC_OPTIMAL al final del render pass.
 //
-void CAVulkanState::createVertexBuffer(size_t vertexSize, const void* vertexData, CAVertexBuffer* vbo)
+void CAVulkanState::saveImage(const char* path)
 {
-	VkBuffer buffer;
-	VkDeviceMemory deviceMemory;
+	if (!headless)
+	{
+		throw std::runtime_error("failed to save image: only available in headless mode!");
+	}
+
+	uint32_t width = swapChainExtent.width;
+	uint32_t height = swapChainExtent.height;
 
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = vertexSize;
-	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	bufferInfo.size = (VkDeviceSize)width * height * 4;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+	VkBuffer readBuffer;
+	if (vkCreateBuffer(device, &bufferInfo, nullptr, &readBuffer) != VK_SUCCESS)
 	{
-		throw std::runtime_error("failed to create buffer!");
+		throw std::runtime_error("failed to create readback buffer!");
 	}
+	CAAllocation readMemory = allocator->allocateBuffer(readBuffer, CA_MEMORY_STAGING);
 
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = uploadCommandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	VkCommandBuffer commandBuffer;
+	if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate readback command buffer!");
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to begin recording readback command buffer!");
+	}
+
+	// La escritura del render pass debe ser visible para la copia
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	VkBufferImageCopy region = {};
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { width, height, 1 };
+	vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[currentImage], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readBuffer, 1, &region);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record readback command buffer!");
+	}
+
+	uint64_t signalValue = submittedValue + 1;
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &timeline;
 
-	if (vkAllocateMemory(device, &allocInfo, nullptr, &deviceMemory) != VK_SUCCESS)
+	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
 	{
-		throw std::runtime_error("failed to allocate buffer memory!");
+		throw std::runtime_error("failed to submit readback command buffer!");
 	}
+	submittedValue = signalValue;
+	waitForValue(signalValue);
+	vkFreeCommandBuffers(device, uploadCommandPool, 1, &commandBuffer);
 
-	vkBindBufferMemory(device, buffer, deviceMemory, 0);
+	if (!readMemory.coherent)
+	{
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = readMemory.memory;
+		range.offset = readMemory.offset;
+		range.size = readMemory.size;
+		vkInvalidateMappedMemoryRanges(device, 1, &range);
+	}
 
-	void* data;
-	vkMapMemory(device, deviceMemory, 0, vertexSize, 0, &data);
-	memcpy(data, vertexData, vertexSize);
-	vkUnmapMemory(device, deviceMemory);
+	// Las imgenes propias son B8G8R8A8: se reordena a RGB y se descarta el alfa
+	std::vector<char> pixels((size_t)width * height * 3);
+	for (size_t i = 0; i < (size_t)width * height; i++)
+	{
+		pixels[3 * i + 0] = readMemory.mapped[4 * i + 2];
+		pixels[3 * i + 1] = readMemory.mapped[4 * i + 1];
+		pixels[3 * i + 2] = readMemory.mapped[4 * i + 0];
+	}
+	vkDestroyBuffer(device, readBuffer, nullptr);
+	allocator->free(readMemory);
 
-	vbo->buffer = buffer;
-	vbo->memory = deviceMemory;
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("failed to open image file!");
+	}
+	file << "P6\n" << width << " " << height << "\n255\n";
+	file.write(pixels.data(), pixels.size());
+	if (!file)
+	{
+		throw std::runtime_error("failed to write image file!");
+	}
 }
 
 //
-// FUNCIN: CAVulkanState::destroyVertexBuffer(CAVertexBuffer vbo)
+// FUNCIN: CAVulkanState::waitForFrameSlot()
 //
-// PROPSITO: Destruye los campos de un Vertex Buffer
+// PROPSITO: Espera a que quede libre el hueco del siguiente fotograma en vuelo y
+//            aplica el limitador. Se llama antes de leer la entrada para que sta
+//            se tome lo ms tarde posible; si no, la llama draw().
 //
-void CAVulkanState::destroyVertexBuffer(CAVertexBuffer vbo)
+void CAVulkanState::waitForFrameSlot()
 {
-	vkDestroyBuffer(device, vbo.buffer, nullptr);
-	vkFreeMemory(device, vbo.memory, nullptr);
+	waitForValue(frameValues[currentFrame]);
+	deletionQueue.collect(completedValue);
+	collectRetiredSwapChains(false);
+
+	limitFrameRate();
+	frameStart = std::chrono::steady_clock::now();
+	slotReady = true;
 }
 
 //
-// FUNCIN: CAVulkanState::createIndexBuffer(size_t bufferSize, void * bufferData, CAIndexBuffer* ibo)
+// FUNCIN: CAVulkanState::markInput()
 //
-// PROPSITO: Crea un Index Buffer
+// PROPSITO: Anota la llegada de un evento de entrada. Se guarda el primero de los
+//            que recoger el prximo fotograma para medir la latencia hasta que se
+//            presenta.
 //
-void CAVulkanState::createIndexBuffer(size_t bufferSize, const void* bufferData, CAIndexBuffer* ibo)
+void CAVulkanState::markInput()
 {
-	VkBuffer buffer;
-	VkDeviceMemory deviceMemory;
-
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = bufferSize;
-	bufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-	if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to create buffer!");
-	}
-
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	if (inputPending) return;
+	inputPending = true;
+	inputTime = std::chrono::steady_clock::now();
+}
 
-	if (vkAllocateMemory(device, &allocInfo, nullptr, &deviceMemory) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to allocate buffer memory!");
-	}
+//
+// FUNCIN: CAVulkanState::getPresentSettings()
+//
+// PROPSITO: Obtiene las opciones de presentacin y latencia
+//
+CAPresentSettings CAVulkanState::getPresentSettings()
+{
+	return settings;
+}
 
-	vkBindBufferMemory(device, buffer, deviceMemory, 0);
+//
+// FUNCIN: CAVulkanState::setPresentSettings(const CAPresentSettings& settings)
+//
+// PROPSITO: Cambia las opciones de presentacin. Un cambio de modo o de fotogramas
+//            en vuelo recrea la swapchain, los objetos de sincronizacin y los
+//            recursos de cada fotograma, para lo que se espera a que la GPU termine.
+//
+void CAVulkanState::setPresentSettings(const CAPresentSettings& settings)
+{
+	bool recreate = settings.presentMode != this->settings.presentMode
+		|| std::max(settings.framesInFlight, 1u) != this->settings.framesInFlight;
 
-	void* data;
-	vkMapMemory(device, deviceMemory, 0, bufferSize, 0, &data);
-	memcpy(data, bufferData, bufferSize);
-	vkUnmapMemory(device, deviceMemory);
+	this->settings = settings;
+	if (this->settings.framesInFlight == 0) this->settings.framesInFlight = 1;
+	nextFrameDeadline = std::chrono::steady_clock::now();
+	latencyStats = {};
+	if (!recreate) return;
 
-	ibo->buffer = buffer;
-	ibo->memory = deviceMemory;
+	vkDeviceWaitIdle(device);
+	deletionQueue.flush();
+	destroyFrameResources();
+	frameCount = this->settings.framesInFlight;
+	createFrameResources();
+	currentFrame = 0;
+	slotReady = false;
+	recreateSwapChain();
 }
 
 //
-// FUNCIN: CAVulkanState::destroyIndexBuffer(CAIndexBuffer ibo)
+// FUNCIN: CAVulkanState::getLatencyStats()
 //
-// PROPSITO: Destruye los campos de un Index Buffer
+// PROPSITO: Obtiene las medidas de latencia entrada-presentacin acumuladas desde el
+//            ltimo informe
 //
-void CAVulkanState::destroyIndexBuffer(CAIndexBuffer ibo)
+CALatencyStats CAVulkanState::getLatencyStats()
 {
-	vkDestroyBuffer(device, ibo.buffer, nullptr);
-	vkFreeMemory(device, ibo.memory, nullptr);
+	return latencyStats;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////
+/////                                                                                 /////
+/////                    Mtodos pblicos de gestin de buffers                       /////
+/////                                                                                 /////
+///////////////////////////////////////////////////////////////////////////////////////////
+ 
 //
-// FUNCIN: CAVulkanState::createIndexBuffer(size_t bufferSize, CAUniformBuffer* ubo)
+// FUNCIN: CAVulkanState::createUniformBuffer(size_t bufferSize, CAUniformBuffer* ubo)
 //
-// PROPSITO: Crea una lista de Uniform Buffers asociados a cada imagen a generar
+// PROPSITO: Crea una lista de Uniform Buffers, uno por cada fotograma en vuelo
 //
 void CAVulkanState::createUniformBuffer(size_t bufferSize, CAUniformBuffer* ubo)
 {
-	ubo->buffers.resize(imageCount);
-	ubo->memories.resize(imageCount);
+	createFrameBuffers(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, ubo);
+}
 
-	for (uint32_t i = 0; i < imageCount; i++)
-	{
-		VkBuffer buffer;
-		VkDeviceMemory deviceMemory;
+//
+// FUNCIN: CAVulkanState::createFrameBuffers(size_t bufferSize, VkBufferUsageFlags usage, CAUniformBuffer* ubo)
+//
+// PROPSITO: Crea un buffer mapeado en memoria visible desde el host por cada
+//            fotograma en vuelo. El valor del timeline del fotograma protege su
+//            copia, as que no hace falta una por imagen de la swapchain.
+//
+void CAVulkanState::createFrameBuffers(size_t bufferSize, VkBufferUsageFlags usage, CAUniformBuffer* ubo)
+{
+	ubo->buffers.resize(frameCount);
+	ubo->memories.resize(frameCount);
 
+	for (uint32_t i = 0; i < frameCount; i++)
+	{
 		VkBufferCreateInfo bufferInfo = {};
 		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 		bufferInfo.size = bufferSize;
-		bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+		bufferInfo.usage = usage;
 		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-		if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+		if (vkCreateBuffer(device, &bufferInfo, nullptr, &ubo->buffers[i]) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create buffer!");
 		}
 
-		VkMemoryRequirements memRequirements;
-		vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+		ubo->memories[i] = allocator->allocateBuffer(ubo->buffers[i], CA_MEMORY_CPU_TO_GPU);
+	}
+}
 
-		VkMemoryAllocateInfo allocInfo = {};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+//
+// FUNCIN: CAVulkanState::updateUniformBuffer(size_t size, const void* data, const CAUniformBuffer& ubo)
+//
+// PROPSITO: Actualiza el valor almacenado en un Uniform Buffer. La memoria est
+//            mapeada desde su creacin y se escribe directamente; si no es
+//            coherente, el rango se anota para volcarlo junto al resto del fotograma.
+//
+void CAVulkanState::updateUniformBuffer(size_t size, const void* data, const CAUniformBuffer& ubo)
+{
+	const CAAllocation& memory = ubo.memories[currentFrame];
+	memcpy(memory.mapped, data, size);
+
+	if (!memory.coherent)
+	{
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = memory.memory;
+		range.offset = memory.offset;
+		range.size = memory.size;
+		mappedRanges.push_back(range);
+	}
+}
 
-		if (vkAllocateMemory(device, &allocInfo, nullptr, &deviceMemory) != VK_SUCCESS)
+//
+// FUNCIN: CAVulkanState::destroyUniformBuffer(CAUniformBuffer ubo)
+//
+// PROPSITO: Destruye los campos de un Uniform Buffer cuando terminen los fotogramas
+//            que pueden usarlo
+//
+void CAVulkanState::destroyUniformBuffer(CAUniformBuffer ubo)
+{
+	deferDestroy([this, ubo]() mutable {
+		for (size_t i = 0; i < ubo.buffers.size(); i++)
 		{
-			throw std::runtime_error("failed to allocate buffer memory!");
+			vkDestroyBuffer(device, ubo.buffers[i], nullptr);
+			allocator->free(ubo.memories[i]);
 		}
-
-		vkBindBufferMemory(device, buffer, deviceMemory, 0);
-
-		ubo->buffers[i] = buffer;
-		ubo->memories[i] = deviceMemory;
-	}
+	});
 }
 
 //
-// FUNCIN: CAVulkanState::updateUniformBuffer(size_t size, const void* data, CAUniformBuffer ubo)
+// FUNCIN: CAVulkanState::getDescriptorSet(VkDescriptorSetLayout layout, VkDescriptorType type, const std::vector<VkDescriptorBufferInfo>& buffers)
 //
-// PROPSITO: Actualiza el valor almacenado en un Uniform Buffer
+// PROPSITO: Obtiene un descriptor set con los buffers indicados en los bindings
+//            consecutivos desde el 0. Los objetos que comparten los mismos buffers
+//            comparten tambin el set, que slo se crea la primera vez.
 //
-void CAVulkanState::updateUniformBuffer(size_t size, const void* data, CAUniformBuffer ubo)
+VkDescriptorSet CAVulkanState::getDescriptorSet(VkDescriptorSetLayout layout, VkDescriptorType type, const std::vector<VkDescriptorBufferInfo>& buffers)
 {
-	void* mdata;
-	vkMapMemory(device, ubo.memories[currentImage], 0, size, 0, &mdata);
-	memcpy(mdata, data, size);
-	vkUnmapMemory(device, ubo.memories[currentImage]);
+	std::vector<uint64_t> key;
+	key.push_back((uint64_t)layout);
+	key.push_back((uint64_t)type);
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		key.push_back((uint64_t)buffers[i].buffer);
+		key.push_back(buffers[i].offset);
+		key.push_back(buffers[i].range);
+	}
+
+	std::map<std::vector<uint64_t>, VkDescriptorSet>::iterator it = descriptorCache.find(key);
+	if (it != descriptorCache.end()) return it->second;
+
+	VkDescriptorSet set = descriptors->allocate(layout);
+	writeDescriptorSet(set, type, buffers);
+
+	descriptorCache[key] = set;
+	return set;
 }
 
 //
-// FUNCIN: CAVulkanState::destroyUniformBuffer(CAUniformBuffer ubo)
+// FUNCIN: CAVulkanState::releaseDescriptorSets(VkBuffer buffer)
 //
-// PROPSITO: Destruye los campos de un Uniform Buffer
+// PROPSITO: Libera los descriptor sets compartidos que apuntan a un buffer que se
+//            va a destruir. Salen de la cach en el acto, pero vuelven al pool cuando
+//            terminan los fotogramas que pueden usarlos.
 //
-void CAVulkanState::destroyUniformBuffer(CAUniformBuffer ubo)
+void CAVulkanState::releaseDescriptorSets(VkBuffer buffer)
 {
-	for (uint32_t i = 0; i < imageCount; i++)
+	std::map<std::vector<uint64_t>, VkDescriptorSet>::iterator it = descriptorCache.begin();
+	while (it != descriptorCache.end())
 	{
-		vkDestroyBuffer(device, ubo.buffers[i], nullptr);
-		vkFreeMemory(device, ubo.memories[i], nullptr);
+		bool uses = false;
+		for (size_t i = 2; i < it->first.size(); i += 3)
+		{
+			if (it->first[i] == (uint64_t)buffer) uses = true;
+		}
+
+		if (uses)
+		{
+			VkDescriptorSet set = it->second;
+			deferDestroy([this, set]() {
+				descriptors->free(set);
+			});
+			it = descriptorCache.erase(it);
+		}
+		else
+		{
+			it++;
+		}
 	}
 }
 
 //
-// FUNCIN:CAVulkanState::createDescriptorSets(VkDescriptorPool* descriptorPool, std::vector<VkDescriptorSet> *descriptorSets, std::vector<CAUniformBuffer> buffers,size_t* bufferSizes, size_t sizes)
+// FUNCIN: CAVulkanState::updateSceneUniform(const CASceneInfo& scene)
 //
-// PROPSITO: Crea los conjuntos de descriptores asociados a los buffers
+// PROPSITO: Actualiza la cmara y la luz de la imagen actual
 //
-void CAVulkanState::createDescriptorSets(VkDescriptorPool* descriptorPool, std::vector<VkDescriptorSet>* descriptorSets, CAUniformBuffer** buffers, size_t* bufferSizes, size_t size)
+void CAVulkanState::updateSceneUniform(const CASceneInfo& scene)
 {
-	std::vector<VkDescriptorPoolSize> poolSizes(size);
+	updateUniformBuffer(sizeof(CASceneInfo), &scene, sceneBuffer);
+}
 
-	for(int i=0; i<size; i++)
+//
+// FUNCIN: CAVulkanState::registerMaterial(const CAMaterial& material)
+//
+// PROPSITO: Obtiene el ndice de un material en la tabla comn, aadindolo si no
+//            estaba. Los objetos con el mismo material comparten la entrada.
+//
+uint32_t CAVulkanState::registerMaterial(const CAMaterial& material)
+{
+	for (size_t i = 0; i < materials.size(); i++)
 	{
-		VkDescriptorPoolSize poolSize = {};
-		poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSize.descriptorCount = imageCount;
-		poolSizes[i] = poolSize;
+		const CAMaterial& m = materials[i];
+		if (m.Ka == material.Ka && m.Kd == material.Kd && m.Ks == material.Ks && m.Shininess == material.Shininess)
+		{
+			return (uint32_t)i;
+		}
 	}
 
-	VkDescriptorPoolCreateInfo poolInfo = {};
-	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolInfo.poolSizeCount = (uint32_t) poolSizes.size();
-	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = imageCount;
+	materials.push_back(material);
+	materialsDirty = true;
 
-	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, descriptorPool) != VK_SUCCESS)
+	if (materials.size() > materialCapacity)
 	{
-		throw std::runtime_error("failed to create descriptor pool!");
+		// Las copias pendientes al buffer anterior se envan antes de retirarlo
+		flushUploads();
+		destroyMaterialTable();
+		createMaterialTable(materialCapacity * 2);
 	}
+	return (uint32_t)(materials.size() - 1);
+}
 
-	std::vector<VkDescriptorSetLayout> layouts(imageCount, descriptorSetLayout);
-	VkDescriptorSetAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = *descriptorPool;
-	allocInfo.descriptorSetCount = imageCount;
-	allocInfo.pSetLayouts = layouts.data();
-
-	(*descriptorSets).resize(imageCount);
+//
+// FUNCIN: CAVulkanState::createMesh(const std::vector<CAVertex>& vertices, const std::vector<uint16_t>& indices)
+//
+// PROPSITO: Aade una malla esttica a los buffers comunes de vrtices e ndices y
+//            devuelve su posicin en ellos. Se reutilizan primero los huecos de las
+//            mallas liberadas con releaseMesh. Los ndices son relativos a la malla y
+//            se desplazan con vertexOffset al dibujar.
+//
+CAMesh CAVulkanState::createMesh(const std::vector<CAVertex>& vertices, const std::vector<uint16_t>& indices)
+{
+	CAMesh mesh;
+	mesh.indexCount = (uint32_t)indices.size();
+	mesh.vertexCount = (uint32_t)vertices.size();
 
-	if (vkAllocateDescriptorSets(device, &allocInfo, (*descriptorSets).data()) != VK_SUCCESS)
+	uint32_t firstVertex = allocateGeometryRange(freeVertexRanges, mesh.vertexCount);
+	if (firstVertex == UINT32_MAX)
+	{
+		firstVertex = (uint32_t)geometryVertices.size();
+		geometryVertices.resize(geometryVertices.size() + vertices.size());
+	}
+	uint32_t firstIndex = allocateGeometryRange(freeIndexRanges, mesh.indexCount);
+	if (firstIndex == UINT32_MAX)
 	{
-		throw std::runtime_error("failed to allocate descriptor sets!");
+		firstIndex = (uint32_t)geometryIndices.size();
+		geometryIndices.resize(geometryIndices.size() + indices.size());
 	}
+	mesh.firstIndex = firstIndex;
+	mesh.vertexOffset = (int32_t)firstVertex;
 
-	for (size_t i = 0; i < imageCount; i++)
+	std::copy(vertices.begin(), vertices.end(), geometryVertices.begin() + firstVertex);
+	std::copy(indices.begin(), indices.end(), geometryIndices.begin() + firstIndex);
+
+	if (geometryVertices.size() > vertexCapacity || geometryIndices.size() > indexCapacity)
+	{
+		uint32_t newVertexCapacity = vertexCapacity;
+		uint32_t newIndexCapacity = indexCapacity;
+		while (newVertexCapacity < geometryVertices.size()) newVertexCapacity *= 2;
+		while (newIndexCapacity < geometryIndices.size()) newIndexCapacity *= 2;
+		resizeGeometryArena(newVertexCapacity, newIndexCapacity);
+	}
+	else
 	{
-		std::vector<VkDescriptorBufferInfo> buffersInfo;
-		buffersInfo.resize(size);
+		writeGeometry(geometryVertexBuffer, geometryVertexMemory, mesh.vertexOffset * sizeof(CAVertex), vertices.size() * sizeof(CAVertex), vertices.data());
+		writeGeometry(geometryIndexBuffer, geometryIndexMemory, mesh.firstIndex * sizeof(uint16_t), indices.size() * sizeof(uint16_t), indices.data());
+	}
+	return mesh;
+}
 
-		for (int j = 0; j < size; j++)
-		{
-			buffersInfo[j] = {};
-			buffersInfo[j].buffer = buffers[j]->buffers[i];
-			buffersInfo[j].offset = 0;
-			buffersInfo[j].range = bufferSizes[j];
-		}
+//
+// FUNCIN: CAVulkanState::releaseMesh(const CAMesh& mesh)
+//
+// PROPSITO: Devuelve el espacio de una malla en los buffers comunes. Los huecos no se
+//            reutilizan hasta que terminan los fotogramas que pueden dibujarla.
+//
+void CAVulkanState::releaseMesh(const CAMesh& mesh)
+{
+	deferDestroy([this, mesh]() {
+		freeGeometryRange(freeVertexRanges, (uint32_t)mesh.vertexOffset, mesh.vertexCount);
+		freeGeometryRange(freeIndexRanges, mesh.firstIndex, mesh.indexCount);
+	});
+}
+
+//
+// FUNCIN: CAVulkanState::addDraw(const CAMesh& mesh, const CAInstance* instances, uint32_t instanceCount)
+//
+// PROPSITO: Aade a la lista del fotograma un dibujo de instanceCount instancias de
+//            una malla. Las instancias se guardan seguidas y el dibujo apunta a la
+//            primera con firstInstance, que el vertex shader recibe en gl_InstanceIndex.
+//
+void CAVulkanState::addDraw(const CAMesh& mesh, const CAInstance* instances, uint32_t instanceCount)
+{
+	if (instanceCount == 0) return;
 
-		VkWriteDescriptorSet descriptorWrite = {};
-		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrite.dstSet = (*descriptorSets)[i];
-		descriptorWrite.dstBinding = 0;
-		descriptorWrite.dstArrayElement = 0;
-		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrite.descriptorCount = (uint32_t) buffersInfo.size();
-		descriptorWrite.pBufferInfo = buffersInfo.data();
+	VkDrawIndexedIndirectCommand command = {};
+	command.indexCount = mesh.indexCount;
+	command.instanceCount = instanceCount;
+	command.firstIndex = mesh.firstIndex;
+	command.vertexOffset = mesh.vertexOffset;
+	command.firstInstance = (uint32_t)drawInstances.size();
 
-		vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
-	}
+	drawCommands.push_back(command);
+	drawInstances.insert(drawInstances.end(), instances, instances + instanceCount);
+}
+
+//
+// FUNCIN: CAVulkanState::addPalette(const std::vector<glm::mat4>& matrices)
+//
+// PROPSITO: Aade a la paleta del fotograma las matrices de un esqueleto horneado y
+//            devuelve la posicin de la primera, que se guarda en PaletteBase
+//
+int32_t CAVulkanState::addPalette(const std::vector<glm::mat4>& matrices)
+{
+	int32_t base = (int32_t)drawPalette.size();
+	drawPalette.insert(drawPalette.end(), matrices.begin(), matrices.end());
+	return base;
 }
 
 //
-// FUNCIN:CAVulkanState::createDescriptorSets(VkDescriptorPool descriptorPool, std::vector<VkDescriptorSet> descriptorSets)
+// FUNCIN: CAVulkanState::getMemoryStats()
 //
-// PROPSITO: Destruye los conjuntos de descriptores
+// PROPSITO: Obtiene las estadsticas del asignador de memoria
 //
-void CAVulkanState::destroyDescriptorSets(VkDescriptorPool descriptorPool, std::vector<VkDescriptorSet> descriptorSets)
+CAMemoryStats CAVulkanState::getMemoryStats()
 {
-	vkFreeDescriptorSets(device, descriptorPool, (uint32_t) descriptorSets.size(), descriptorSets.data());
-	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	return allocator->getStats();
 }
 
 //
@@ -409,11 +802,12 @@ void CAVulkanState::createInstance()
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	appInfo.pEngineName = "No Engine";
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	appInfo.apiVersion = VK_API_VERSION_1_0;
+	appInfo.apiVersion = VK_API_VERSION_1_2;
 
+	// Sin ventana no hace falta ninguna extensin de superficie
 	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	const char** glfwExtensions = nullptr;
+	if (!headless) glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
 	VkInstanceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -541,24 +935,51 @@ void CAVulkanState::createLogicalDevice()
 	createInfo.enabledExtensionCount = 0;
 	createInfo.enabledLayerCount = 0;
 
-	std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+	std::vector<const char*> deviceExtensions;
+	if (!headless) deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
 	VkPhysicalDeviceFeatures supportedFeatures = {};
 	VkPhysicalDeviceFeatures requiredFeatures = {};
 	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
 	requiredFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	requiredFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
 	requiredFeatures.tessellationShader = VK_TRUE;
 	requiredFeatures.geometryShader = VK_TRUE;
 	createInfo.pEnabledFeatures = &requiredFeatures;
 
+	// La sincronizacin de los envos usa un semforo timeline (Vulkan 1.2)
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	if (deviceProperties.apiVersion < VK_API_VERSION_1_2)
+	{
+		throw std::runtime_error("failed to find a Vulkan 1.2 device!");
+	}
+
+	VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+	timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+	VkPhysicalDeviceFeatures2 supportedFeatures2 = {};
+	supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supportedFeatures2.pNext = &timelineFeatures;
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+	if (timelineFeatures.timelineSemaphore != VK_TRUE)
+	{
+		throw std::runtime_error("failed to find timeline semaphore support!");
+	}
+	timelineFeatures.pNext = nullptr;
+	createInfo.pNext = &timelineFeatures;
+
 	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	createInfo.ppEnabledExtensionNames = deviceExtensions.empty() ? nullptr : deviceExtensions.data();
 
 	if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create logical device!");
 	}
 
+	// Sin firstInstance en los comandos indirectos no se puede elegir la instancia de cada dibujo
+	multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+	indirectDraws = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+
 	vkGetDeviceQueue(device, graphicsQueueFamilyIndex, 0, &graphicsQueue);
 	vkGetDeviceQueue(device, presentQueueFamilyIndex, 0, &presentQueue);
 }
@@ -588,7 +1009,19 @@ void CAVulkanState::createSwapChain()
 	VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(formats);
 	VkExtent2D extent = chooseSwapExtent(capabilities);
 
-	imageCount = 4;
+	uint32_t presentModeCount;
+	vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, nullptr);
+	if (presentModeCount != 0)
+	{
+		presentModes.resize(presentModeCount);
+		vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, presentModes.data());
+	}
+	presentMode = chooseSwapPresentMode(presentModes);
+
+	// Una imagen ms que fotogramas en vuelo (la que se est mostrando); MAILBOX
+	// necesita al menos tres para no bloquear
+	imageCount = std::max(settings.framesInFlight + 1, capabilities.minImageCount);
+	if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR) imageCount = std::max(imageCount, 3u);
 	if (capabilities.maxImageCount > 0 && imageCount > capabilities.maxImageCount)
 	{
 		imageCount = capabilities.maxImageCount;
@@ -624,8 +1057,9 @@ void CAVulkanState::createSwapChain()
 
 	createInfo.preTransform = capabilities.currentTransform;
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-	createInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE;
+	createInfo.oldSwapchain = swapChain;
 
 	if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS)
 	{
@@ -640,6 +1074,76 @@ void CAVulkanState::createSwapChain()
 	swapChainExtent = extent;
 }
 
+//
+// FUNCIN: CAVulkanState::createOffscreenImages()
+//
+// PROPSITO: En modo sin ventana, crea las imgenes sobre las que se genera en lugar
+//            de las de la swapchain: una por fotograma en vuelo, con el formato que
+//            se suele elegir para la superficie. Admiten copias para poder leerlas.
+//
+void CAVulkanState::createOffscreenImages()
+{
+	imageCount = frameCount;
+	swapChainImageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+	swapChainExtent = { static_cast<uint32_t>(wWidth), static_cast<uint32_t>(wHeight) };
+	swapChainImages.resize(imageCount);
+	offscreenMemories.resize(imageCount);
+
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		VkImageCreateInfo imageInfo = {};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width = swapChainExtent.width;
+		imageInfo.extent.height = swapChainExtent.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = swapChainImageFormat;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateImage(device, &imageInfo, nullptr, &swapChainImages[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create offscreen image!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(device, swapChainImages[i], &memRequirements);
+
+		VkMemoryAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &offscreenMemories[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate offscreen image memory!");
+		}
+
+		vkBindImageMemory(device, swapChainImages[i], offscreenMemories[i], 0);
+	}
+}
+
+//
+// FUNCIN: CAVulkanState::destroyOffscreenImages()
+//
+// PROPSITO: Destruye las imgenes del modo sin ventana
+//
+void CAVulkanState::destroyOffscreenImages()
+{
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		vkDestroyImage(device, swapChainImages[i], nullptr);
+		vkFreeMemory(device, offscreenMemories[i], nullptr);
+	}
+	swapChainImages.clear();
+	offscreenMemories.clear();
+}
+
 //
 // FUNCIN: CAVulkanState::createImageViews()
 //
@@ -689,7 +1193,9 @@ void CAVulkanState::createRenderPass()
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// Sin ventana la imagen queda lista para copiarse en lugar de para presentarse;
+	// el render pass sigue siendo compatible con el pipeline
+	colorAttachment.finalLayout = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	VkAttachmentDescription depthAttachment = {};
 	depthAttachment.format = findDepthFormat();
@@ -718,8 +1224,10 @@ void CAVulkanState::createRenderPass()
 	VkSubpassDependency dependency = {};
 	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
 	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-	dependency.srcAccessMask = 0;
+	// Todos los fotogramas comparten la imagen de profundidad: el borrado del siguiente
+	// espera a las escrituras de profundidad del anterior
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
@@ -752,43 +1260,76 @@ void CAVulkanState::createRenderPass()
 //
 void CAVulkanState::createPipelineLayout()
 {
-	VkDescriptorSetLayoutBinding transformLayoutBinding = {};
-	transformLayoutBinding.binding = 0;
-	transformLayoutBinding.descriptorCount = 1;
-	transformLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	transformLayoutBinding.pImmutableSamplers = nullptr;
-	transformLayoutBinding.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
-
-	VkDescriptorSetLayoutBinding lightLayoutBinding = {};
-	lightLayoutBinding.binding = 1;
-	lightLayoutBinding.descriptorCount = 1;
-	lightLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	lightLayoutBinding.pImmutableSamplers = nullptr;
-	lightLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	// Set 0: variables comunes a la escena (cmara y luz)
+	VkDescriptorSetLayoutBinding sceneLayoutBinding = {};
+	sceneLayoutBinding.binding = 0;
+	sceneLayoutBinding.descriptorCount = 1;
+	sceneLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	sceneLayoutBinding.pImmutableSamplers = nullptr;
+	sceneLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutCreateInfo sceneLayoutInfo = {};
+	sceneLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	sceneLayoutInfo.bindingCount = 1;
+	sceneLayoutInfo.pBindings = &sceneLayoutBinding;
+
+	if (vkCreateDescriptorSetLayout(device, &sceneLayoutInfo, nullptr, &sceneSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create descriptor set layout!");
+	}
 
+	// Set 1: tabla de materiales
 	VkDescriptorSetLayoutBinding materialLayoutBinding = {};
-	materialLayoutBinding.binding = 2;
+	materialLayoutBinding.binding = 0;
 	materialLayoutBinding.descriptorCount = 1;
-	materialLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	materialLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	materialLayoutBinding.pImmutableSamplers = nullptr;
 	materialLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-	VkDescriptorSetLayoutBinding pBindings[] = { transformLayoutBinding, lightLayoutBinding , materialLayoutBinding };
-
-	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfo.bindingCount = 3;
-	layoutInfo.pBindings = pBindings;
+	VkDescriptorSetLayoutCreateInfo materialLayoutInfo = {};
+	materialLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	materialLayoutInfo.bindingCount = 1;
+	materialLayoutInfo.pBindings = &materialLayoutBinding;
 
-	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+	if (vkCreateDescriptorSetLayout(device, &materialLayoutInfo, nullptr, &materialSetLayout) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create descriptor set layout!");
 	}
 
+	// Set 2: matrices y materiales de todas las instancias del fotograma (binding 0)
+	// y paleta de matrices de los esqueletos horneados (binding 1)
+	VkDescriptorSetLayoutBinding instanceLayoutBinding = {};
+	instanceLayoutBinding.binding = 0;
+	instanceLayoutBinding.descriptorCount = 1;
+	instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	instanceLayoutBinding.pImmutableSamplers = nullptr;
+	instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkDescriptorSetLayoutBinding paletteLayoutBinding = {};
+	paletteLayoutBinding.binding = 1;
+	paletteLayoutBinding.descriptorCount = 1;
+	paletteLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	paletteLayoutBinding.pImmutableSamplers = nullptr;
+	paletteLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkDescriptorSetLayoutBinding drawBindings[] = { instanceLayoutBinding, paletteLayoutBinding };
+
+	VkDescriptorSetLayoutCreateInfo instanceLayoutInfo = {};
+	instanceLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	instanceLayoutInfo.bindingCount = 2;
+	instanceLayoutInfo.pBindings = drawBindings;
+
+	if (vkCreateDescriptorSetLayout(device, &instanceLayoutInfo, nullptr, &instanceSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create descriptor set layout!");
+	}
+
+	VkDescriptorSetLayout setLayouts[] = { sceneSetLayout, materialSetLayout, instanceSetLayout };
+
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 1;
-	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+	pipelineLayoutInfo.setLayoutCount = 3;
+	pipelineLayoutInfo.pSetLayouts = setLayouts;
 	pipelineLayoutInfo.pushConstantRangeCount = 0;
 
 	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
@@ -810,9 +1351,9 @@ void CAVulkanState::createGraphicsPipeline()
 	VkVertexInputAttributeDescription* attributeDescriptions = nullptr;
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo;
 	VkPipelineInputAssemblyStateCreateInfo inputAssembly;
-	VkViewport viewport;
-	VkRect2D scissor;
 	VkPipelineViewportStateCreateInfo viewportState;
+	VkDynamicState dynamicStates[2];
+	VkPipelineDynamicStateCreateInfo dynamicState;
 	VkPipelineRasterizationStateCreateInfo rasterizer;
 	VkPipelineMultisampleStateCreateInfo multisampling;
 	VkPipelineDepthStencilStateCreateInfo depthStencil;
@@ -824,7 +1365,8 @@ void CAVulkanState::createGraphicsPipeline()
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
 	createPipelineVertexInputStateCreateInfo(&vertexInputInfo, bindingDescriptions, attributeDescriptions);
 	createPipelineInputAssemblyStateCreateInfo(&inputAssembly);
-	createPipelineViewportStateCreateInfo(&viewportState, &viewport, &scissor);
+	createPipelineViewportStateCreateInfo(&viewportState);
+	createPipelineDynamicStateCreateInfo(&dynamicState, dynamicStates);
 	createPipelineRasterizationStateCreateInfo(&rasterizer);
 	createPipelineMultisampleStateCreateInfo(&multisampling);
 	createPipelineDepthStencilStateCreateInfo(&depthStencil);
@@ -841,12 +1383,13 @@ void CAVulkanState::createGraphicsPipeline()
 	pipelineInfo.pMultisampleState = &multisampling;
 	pipelineInfo.pDepthStencilState = &depthStencil;
 	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
 	pipelineInfo.layout = pipelineLayout;
 	pipelineInfo.renderPass = renderPass;
 	pipelineInfo.subpass = 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
+	if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create graphics pipeline!");
 	}
@@ -857,72 +1400,80 @@ void CAVulkanState::createGraphicsPipeline()
 
 
 //
-// FUNCIN: CAVulkanState::createDepthBuffers()
+// FUNCIN: CAVulkanState::createDepthBuffer()
 //
-// PROPSITO: Crea los buffers de profundidad
+// PROPSITO: Crea el buffer de profundidad. Es nico y lo comparten los framebuffers
+//            de todas las imgenes; la dependencia del render pass ordena su uso
+//            entre fotogramas.
 //
-void CAVulkanState::createDepthBuffers()
+void CAVulkanState::createDepthBuffer()
 {
-	depthImages.resize(imageCount);
-	depthImageMemories.resize(imageCount);
-	depthImageViews.resize(imageCount);
 	VkFormat depthFormat = findDepthFormat();
 
-	for (size_t i = 0; i < imageCount; i++)
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = swapChainExtent.width;
+	imageInfo.extent.height = swapChainExtent.height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = depthFormat;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateImage(device, &imageInfo, nullptr, &depthImage) != VK_SUCCESS)
 	{
-		VkImageCreateInfo imageInfo = {};
-		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imageInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageInfo.extent.width = swapChainExtent.width;
-		imageInfo.extent.height = swapChainExtent.height;
-		imageInfo.extent.depth = 1;
-		imageInfo.mipLevels = 1;
-		imageInfo.arrayLayers = 1;
-		imageInfo.format = depthFormat;
-		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-		if (vkCreateImage(device, &imageInfo, nullptr, &depthImages[i]) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to create image!");
-		}
+		throw std::runtime_error("failed to create image!");
+	}
 
-		VkMemoryRequirements memRequirements;
-		vkGetImageMemoryRequirements(device, depthImages[i], &memRequirements);
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(device, depthImage, &memRequirements);
 
-		VkMemoryAllocateInfo allocInfo = {};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = memRequirements.size;
+	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-		if (vkAllocateMemory(device, &allocInfo, nullptr, &depthImageMemories[i]) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to allocate image memory!");
-		}
+	if (vkAllocateMemory(device, &allocInfo, nullptr, &depthImageMemory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate image memory!");
+	}
 
-		vkBindImageMemory(device, depthImages[i], depthImageMemories[i], 0);
+	vkBindImageMemory(device, depthImage, depthImageMemory, 0);
 
-		VkImageViewCreateInfo viewInfo = {};
-		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		viewInfo.image = depthImages[i];
-		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		viewInfo.format = depthFormat;
-		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-		viewInfo.subresourceRange.baseMipLevel = 0;
-		viewInfo.subresourceRange.levelCount = 1;
-		viewInfo.subresourceRange.baseArrayLayer = 0;
-		viewInfo.subresourceRange.layerCount = 1;
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = depthImage;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = depthFormat;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
 
-		if (vkCreateImageView(device, &viewInfo, nullptr, &depthImageViews[i]) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to create texture image view!");
-		}
+	if (vkCreateImageView(device, &viewInfo, nullptr, &depthImageView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create texture image view!");
 	}
 }
 
+//
+// FUNCIN: CAVulkanState::destroyDepthBuffer()
+//
+// PROPSITO: Destruye el buffer de profundidad
+//
+void CAVulkanState::destroyDepthBuffer()
+{
+	vkDestroyImageView(device, depthImageView, nullptr);
+	vkFreeMemory(device, depthImageMemory, nullptr);
+	vkDestroyImage(device, depthImage, nullptr);
+}
+
 //
 // FUNCIN: CAVulkanState::createFramebuffers()
 //
@@ -934,7 +1485,7 @@ void CAVulkanState::createFramebuffers()
 
 	for (size_t i = 0; i < imageCount; i++)
 	{
-		VkImageView attachments[] = { swapChainImageViews[i], depthImageViews[i] };
+		VkImageView attachments[] = { swapChainImageViews[i], depthImageView };
 
 		VkFramebufferCreateInfo framebufferInfo{};
 		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -955,12 +1506,14 @@ void CAVulkanState::createFramebuffers()
 //
 // FUNCIN: CAVulkanState::createCommandPool()
 //
-// PROPSITO: Crea el command pool vinculado a la familia de colas para grficos
+// PROPSITO: Crea el command pool vinculado a la familia de colas para grficos. Los
+//            command buffers primarios se vuelven a grabar en cada fotograma.
 //
 void CAVulkanState::createCommandPool()
 {
 	VkCommandPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 	poolInfo.queueFamilyIndex = graphicsQueueFamilyIndex;
 
 	if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
@@ -977,13 +1530,13 @@ void CAVulkanState::createCommandPool()
 //
 void CAVulkanState::createCommandBuffers()
 {
-	commandBuffers.resize(imageCount);
+	commandBuffers.resize(frameCount);
 
 	VkCommandBufferAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfo.commandPool = commandPool;
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = imageCount;
+	allocInfo.commandBufferCount = frameCount;
 
 	if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
 	{
@@ -992,88 +1545,384 @@ void CAVulkanState::createCommandBuffers()
 }
 
 //
-// FUNCIN: CAVulkanState::fillCommandBuffers()
+// FUNCIN: CAVulkanState::createRecordPools()
 //
-// PROPSITO: Crea el contenido de los buffers de comandos
+// PROPSITO: Crea, para cada fotograma en vuelo, un command pool por trabajo de grabacin. Los
+//            command buffers secundarios se reservan en ellos segn se necesitan y se
+//            reinician uno a uno al volver a grabarlos.
 //
-void CAVulkanState::fillCommandBuffers()
+void CAVulkanState::createRecordPools()
 {
-	for (size_t i = 0; i < imageCount; i++)
+	recordPoolCount = jobs->getWorkerCount();
+	recordPools.resize(frameCount * recordPoolCount);
+	recordedPartitions.clear();
+	recordedPartitions.resize(frameCount);
+	primaryPartitions.assign(frameCount, UINT32_MAX);
+	primaryImages.assign(frameCount, UINT32_MAX);
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = graphicsQueueFamilyIndex;
+
+	for (size_t i = 0; i < recordPools.size(); i++)
+	{
+		recordPools[i].buffers.clear();
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &recordPools[i].pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create record command pool!");
+		}
+	}
+	recordResults.resize(recordPoolCount);
+}
+
+//
+// FUNCIN: CAVulkanState::destroyRecordPools()
+//
+// PROPSITO: Destruye los command pools de grabacin y sus command buffers secundarios
+//
+void CAVulkanState::destroyRecordPools()
+{
+	for (size_t i = 0; i < recordPools.size(); i++)
+	{
+		vkDestroyCommandPool(device, recordPools[i].pool, nullptr);
+	}
+	recordPools.clear();
+}
+
+//
+// FUNCIN: CAVulkanState::recordCommandBuffer(uint32_t frame, uint32_t image)
+//
+// PROPSITO: Graba los command buffers del fotograma con su lista de dibujo.
+//            La lista se divide en particiones de DRAWS_PER_PARTITION dibujos y cada una
+//            tiene su command buffer secundario, que slo se vuelve a grabar si la
+//            particin ha cambiado (ver isPartitionDirty). Las particiones que cambian se
+//            graban en paralelo: el trabajo p usa el pool p del fotograma, que contiene
+//            los secundarios de las particiones p, p + recordPoolCount... Los
+//            secundarios no dependen de la imagen de la swapchain; el primario abre el
+//            render pass sobre su framebuffer y ejecuta los secundarios en orden, y se
+//            graba de nuevo si ha cambiado alguna particin, su nmero o la imagen.
+//
+void CAVulkanState::recordCommandBuffer(uint32_t frame, uint32_t image)
+{
+	uint32_t drawCount = (uint32_t)drawCommands.size();
+	uint32_t partitionCount = (drawCount + DRAWS_PER_PARTITION - 1) / DRAWS_PER_PARTITION;
+	std::vector<CARecordedPartition>& recorded = recordedPartitions[frame];
+	if (recorded.size() < partitionCount)
 	{
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		recorded.resize(partitionCount, { 0, {} });
+	}
 
-		if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS)
+	bool primaryDirty = (primaryPartitions[frame] != partitionCount || primaryImages[frame] != image);
+	partitionDirty.assign(partitionCount, 0);
+	for (uint32_t i = 0; i < partitionCount; i++)
+	{
+		uint32_t first = i * DRAWS_PER_PARTITION;
+		if (isPartitionDirty(recorded[i], first, std::min(DRAWS_PER_PARTITION, drawCount - first)))
 		{
-			throw std::runtime_error("failed to begin recording command buffer!");
+			partitionDirty[i] = 1;
+			primaryDirty = true;
 		}
+	}
+	if (!primaryDirty) return;
 
-		VkClearValue clearValues[2];
-		clearValues[0].color = { 1.0f, 1.0f, 1.0f, 1.0f };
-		clearValues[1].depthStencil = { 1.0f, 0 };
+	uint32_t jobCount = std::min(partitionCount, recordPoolCount);
+	for (uint32_t p = 0; p < jobCount; p++) recordResults[p] = VK_SUCCESS;
 
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = renderPass;
-		renderPassInfo.framebuffer = swapChainFramebuffers[i];
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = swapChainExtent;
-		renderPassInfo.clearValueCount = 2;
-		renderPassInfo.pClearValues = clearValues;
+	jobs->parallelFor(jobCount, [this, frame, drawCount, partitionCount, &recorded](size_t p, uint32_t worker) {
+		CARecordPool& recordPool = recordPools[frame * recordPoolCount + p];
 
-		vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		for (uint32_t i = (uint32_t)p; i < partitionCount && recordResults[p] == VK_SUCCESS; i += recordPoolCount)
+		{
+			if (!partitionDirty[i]) continue;
 
-		model->addCommands(commandBuffers[i], (int)i);
+			// Los secundarios del pool se reservan en el orden de sus particiones
+			while (recordPool.buffers.size() <= i / recordPoolCount)
+			{
+				VkCommandBufferAllocateInfo allocInfo = {};
+				allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+				allocInfo.commandPool = recordPool.pool;
+				allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+				allocInfo.commandBufferCount = 1;
+
+				VkCommandBuffer buffer;
+				recordResults[p] = vkAllocateCommandBuffers(device, &allocInfo, &buffer);
+				if (recordResults[p] != VK_SUCCESS) return;
+				recordPool.buffers.push_back(buffer);
+			}
 
-		vkCmdEndRenderPass(commandBuffers[i]);
+			uint32_t first = i * DRAWS_PER_PARTITION;
+			uint32_t count = std::min(DRAWS_PER_PARTITION, drawCount - first);
+			recorded[i].generation = 0;
+			recordResults[p] = recordPartition(recordPool.buffers[i / recordPoolCount], frame, first, count);
+			if (recordResults[p] == VK_SUCCESS)
+			{
+				recorded[i].generation = recordGeneration;
+				recorded[i].draws.assign(drawCommands.begin() + first, drawCommands.begin() + first + count);
+			}
+		}
+	});
 
-		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS)
+	// Los trabajos no lanzan excepciones desde los hilos: se comprueba aqu
+	for (uint32_t p = 0; p < jobCount; p++)
+	{
+		if (recordResults[p] != VK_SUCCESS)
 		{
-			throw std::runtime_error("failed to record command buffer!");
+			primaryPartitions[frame] = UINT32_MAX;
+			throw std::runtime_error("failed to record secondary command buffer!");
 		}
 	}
+
+	partitionBuffers.resize(partitionCount);
+	for (uint32_t i = 0; i < partitionCount; i++)
+	{
+		partitionBuffers[i] = recordPools[frame * recordPoolCount + i % recordPoolCount].buffers[i / recordPoolCount];
+	}
+
+	VkCommandBuffer commandBuffer = commandBuffers[frame];
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+	primaryPartitions[frame] = UINT32_MAX;
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to begin recording command buffer!");
+	}
+
+	VkClearValue clearValues[2];
+	clearValues[0].color = { 1.0f, 1.0f, 1.0f, 1.0f };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderPass;
+	renderPassInfo.framebuffer = swapChainFramebuffers[image];
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = swapChainExtent;
+	renderPassInfo.clearValueCount = 2;
+	renderPassInfo.pClearValues = clearValues;
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	if (partitionCount > 0)
+	{
+		vkCmdExecuteCommands(commandBuffer, partitionCount, partitionBuffers.data());
+	}
+	vkCmdEndRenderPass(commandBuffer);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record command buffer!");
+	}
+	primaryPartitions[frame] = partitionCount;
+	primaryImages[frame] = image;
+}
+
+//
+// FUNCIN: CAVulkanState::isPartitionDirty(const CARecordedPartition& partition, uint32_t firstDraw, uint32_t drawCount)
+//
+// PROPSITO: Indica si hay que volver a grabar una particin. Cambia si se han
+//            recreado los recursos que enlaza (recordGeneration) o su nmero de
+//            dibujos. Con dibujo indirecto los parmetros se leen del buffer de
+//            comandos, as que slo se comparan si se graban con vkCmdDrawIndexed.
+//
+bool CAVulkanState::isPartitionDirty(const CARecordedPartition& partition, uint32_t firstDraw, uint32_t drawCount)
+{
+	if (partition.generation != recordGeneration || partition.draws.size() != drawCount) return true;
+	if (indirectDraws) return false;
+	return memcmp(partition.draws.data(), drawCommands.data() + firstDraw, drawCount * sizeof(VkDrawIndexedIndirectCommand)) != 0;
+}
+
+//
+// FUNCIN: CAVulkanState::recordPartition(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t firstDraw, uint32_t drawCount)
+//
+// PROPSITO: Graba en un command buffer secundario los dibujos [firstDraw, firstDraw + drawCount)
+//            de la lista. Se llama desde los hilos de trabajo, por lo que devuelve el
+//            resultado en lugar de lanzar excepciones. vkBeginCommandBuffer reinicia
+//            el contenido anterior del buffer. No se indica framebuffer para que el
+//            secundario sirva con cualquier imagen de la swapchain.
+//
+VkResult CAVulkanState::recordPartition(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t firstDraw, uint32_t drawCount)
+{
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	if (result != VK_SUCCESS) return result;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+
+	// El estado dinmico no se hereda del primario: cada secundario lo fija
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)swapChainExtent.width;
+	viewport.height = (float)swapChainExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	VkDescriptorSet sets[] = { sceneSets[frame], materialSet, instanceSets[frame] };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 3, sets, 0, nullptr);
+
+	addDrawCommands(commandBuffer, frame, firstDraw, drawCount);
+
+	return vkEndCommandBuffer(commandBuffer);
 }
 
 //
 // FUNCIN: CAVulkanState::createSyncObjects()
 //
-// PROPSITO: Crea los semforos y los fences para no sobreescribir las imgenes
+// PROPSITO: Crea los semforos binarios de cada fotograma en vuelo, que slo se usan
+//            con la swapchain (adquisicin y presentacin). El fin de cada fotograma
+//            se sigue con el timeline: frameValues guarda el valor que sealiz.
 //
 void CAVulkanState::createSyncObjects()
 {
-	frameCount = imageCount - 1;
 	imageAvailableSemaphores.resize(frameCount);
 	renderFinishedSemaphores.resize(frameCount);
-	inFlightFences.resize(frameCount);
-	imagesInFlight.resize(swapChainImages.size(), VK_NULL_HANDLE);
+	frameValues.assign(frameCount, 0);
 
 	VkSemaphoreCreateInfo semaphoreInfo = {};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	VkFenceCreateInfo fenceInfo = {};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
 	for (size_t i = 0; i < frameCount; i++)
 	{
 		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-			vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-			vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS)
+			vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create synchronization objects for a frame!");
 		}
 	}
 }
 
+//
+// FUNCIN: CAVulkanState::destroySyncObjects()
+//
+// PROPSITO: Destruye los semforos de los fotogramas en vuelo
+//
+void CAVulkanState::destroySyncObjects()
+{
+	for (size_t i = 0; i < frameCount; i++)
+	{
+		vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+		vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+	}
+}
+
+//
+// FUNCIN: CAVulkanState::createTimeline()
+//
+// PROPSITO: Crea el semforo timeline de la cola grfica. Cada envo (fotogramas y
+//            lotes de copias) sealiza el siguiente valor de submittedValue, de modo
+//            que un valor alcanzado indica que han terminado todos los anteriores.
+//
+void CAVulkanState::createTimeline()
+{
+	VkSemaphoreTypeCreateInfo typeInfo = {};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+
+	if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create timeline semaphore!");
+	}
+}
+
+//
+// FUNCIN: CAVulkanState::destroyTimeline()
+//
+// PROPSITO: Destruye el semforo timeline
+//
+void CAVulkanState::destroyTimeline()
+{
+	vkDestroySemaphore(device, timeline, nullptr);
+}
+
+//
+// FUNCIN: CAVulkanState::waitForValue(uint64_t value)
+//
+// PROPSITO: Espera en la CPU a que el timeline alcance value y actualiza
+//            completedValue. Si ya se sabe alcanzado no llama al driver.
+//
+void CAVulkanState::waitForValue(uint64_t value)
+{
+	if (value <= completedValue) return;
+
+	VkSemaphoreWaitInfo waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &timeline;
+	waitInfo.pValues = &value;
+
+	if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to wait for timeline semaphore!");
+	}
+
+	uint64_t reached;
+	vkGetSemaphoreCounterValue(device, timeline, &reached);
+	completedValue = std::max(value, reached);
+}
+
+//
+// FUNCIN: CAVulkanState::deferDestroy(const std::function<void()>& destroy)
+//
+// PROPSITO: Pospone la destruccin de un recurso hasta que termine el ltimo envo
+//            que puede usarlo. Si se est preparando un fotograma, ese envo es el
+//            del propio fotograma: la destruccin se guarda en frameDestroys y pasa a
+//            la cola de destruccin con su valor del timeline al enviarlo.
+//
+void CAVulkanState::deferDestroy(const std::function<void()>& destroy)
+{
+	if (recordingFrame)
+	{
+		frameDestroys.push_back(destroy);
+	}
+	else
+	{
+		deletionQueue.push(submittedValue, destroy);
+	}
+}
+
 //
 // FUNCIN: CAVulkanState::recreateSwapChain()
 //
 // PROPSITO: Reconstruye las estructuras vinculadas a la swapchain con el
-//            nuevo tamao de ventana
+//            nuevo tamao de ventana. La nueva swapchain se crea a partir de la
+//            anterior (oldSwapchain) sin vaciar la GPU: la imagen de profundidad pasa
+//            a la cola de destruccin y se destruye cuando terminan los fotogramas ya
+//            enviados. La swapchain anterior, sus vistas y sus framebuffers esperan
+//            adems a su ltima presentacin (ver collectRetiredSwapChains). Slo se
+//            recrean los recursos que dependen del tamao; el render pass y el
+//            pipeline se conservan salvo que cambie el formato de las imgenes.
 //
 void CAVulkanState::recreateSwapChain()
 {
+	if (headless)
+	{
+		recreateOffscreenImages();
+		return;
+	}
+
 	int width = 0, height = 0;
 	glfwGetFramebufferSize(window, &width, &height);
 	while (width == 0 || height == 0)
@@ -1081,31 +1930,164 @@ void CAVulkanState::recreateSwapChain()
 		glfwGetFramebufferSize(window, &width, &height);
 		glfwWaitEvents();
 	}
-	vkDeviceWaitIdle(device);
 
-	vkFreeCommandBuffers(device, commandPool, imageCount, commandBuffers.data());
-	vkDestroyCommandPool(device, commandPool, nullptr);
-	for (uint32_t i = 0; i < imageCount; i++)
+	VkSwapchainKHR oldSwapChain = swapChain;
+	std::vector<VkImageView> oldImageViews = swapChainImageViews;
+	std::vector<VkFramebuffer> oldFramebuffers = swapChainFramebuffers;
+	VkImage oldDepthImage = depthImage;
+	VkDeviceMemory oldDepthMemory = depthImageMemory;
+	VkImageView oldDepthView = depthImageView;
+	deletionQueue.push(submittedValue, [device = device, oldDepthImage, oldDepthMemory, oldDepthView]() {
+		vkDestroyImageView(device, oldDepthView, nullptr);
+		vkFreeMemory(device, oldDepthMemory, nullptr);
+		vkDestroyImage(device, oldDepthImage, nullptr);
+	});
+
+	// Las que an esperaban a una presentacin en la swapchain que se sustituye pasan
+	// a esperar a la nueva: la imagen que anotaron no se volver a adquirir
+	for (size_t i = 0; i < retiredSwapChains.size(); i++)
 	{
-		vkDestroyImageView(device, depthImageViews[i], nullptr);
-		vkFreeMemory(device, depthImageMemories[i], nullptr);
-		vkDestroyImage(device, depthImages[i], nullptr);
-		vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
-		vkDestroyImageView(device, swapChainImageViews[i], nullptr);
+		if (retiredSwapChains[i].value != 0) continue;
+		retiredSwapChains[i].presentedImage = UINT32_MAX;
+		retiredSwapChains[i].acquired = false;
 	}
-	vkDestroyPipeline(device, graphicsPipeline, nullptr);
-	vkDestroyRenderPass(device, renderPass, nullptr);
-	vkDestroySwapchainKHR(device, swapChain, nullptr);
 
+	CARetiredSwapChain retired;
+	retired.destroy = [device = device, oldSwapChain, oldImageViews, oldFramebuffers]() {
+		for (size_t i = 0; i < oldFramebuffers.size(); i++)
+		{
+			vkDestroyFramebuffer(device, oldFramebuffers[i], nullptr);
+			vkDestroyImageView(device, oldImageViews[i], nullptr);
+		}
+		vkDestroySwapchainKHR(device, oldSwapChain, nullptr);
+	};
+	retired.presentedImage = UINT32_MAX;
+	retired.acquired = false;
+	retired.value = 0;
+	retiredSwapChains.push_back(retired);
+
+	VkFormat oldFormat = swapChainImageFormat;
 	createSwapChain();
 	createImageViews();
-	createRenderPass();
-	createGraphicsPipeline();
-	createDepthBuffers();
+	if (swapChainImageFormat != oldFormat)
+	{
+		VkPipeline oldPipeline = graphicsPipeline;
+		VkRenderPass oldRenderPass = renderPass;
+		deletionQueue.push(submittedValue, [device = device, oldPipeline, oldRenderPass]() {
+			vkDestroyPipeline(device, oldPipeline, nullptr);
+			vkDestroyRenderPass(device, oldRenderPass, nullptr);
+		});
+		createRenderPass();
+		createGraphicsPipeline();
+	}
+	createDepthBuffer();
 	createFramebuffers();
-	createCommandPool();
+
+	// Los recursos de cada fotograma no dependen del nmero de imgenes, pero los
+	// command buffers grabados usan los framebuffers y el tamao anteriores
+	primaryPartitions.assign(frameCount, UINT32_MAX);
+	primaryImages.assign(frameCount, UINT32_MAX);
+	recordGeneration++;
+}
+
+//
+// FUNCIN: CAVulkanState::collectRetiredSwapChains(bool all)
+//
+// PROPSITO: Destruye las swapchains sustituidas cuya ltima presentacin ha
+//            terminado. Sin VK_EXT_swapchain_maintenance1 no hay forma de saber cundo
+//            acaba una presentacin, as que se espera a que un fotograma vuelva a
+//            adquirir la primera imagen presentada en la swapchain nueva y termine:
+//            esa presentacin ha acabado y, como las de la cola se completan en
+//            orden, tambin las de la swapchain anterior. Con all se destruyen todas
+//            (al cerrar, con el dispositivo ya parado).
+//
+void CAVulkanState::collectRetiredSwapChains(bool all)
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < retiredSwapChains.size(); i++)
+	{
+		CARetiredSwapChain& retired = retiredSwapChains[i];
+		if (all || (retired.value != 0 && retired.value <= completedValue))
+		{
+			retired.destroy();
+			continue;
+		}
+		retiredSwapChains[kept++] = retired;
+	}
+	retiredSwapChains.resize(kept);
+}
+
+//
+// FUNCIN: CAVulkanState::recreateOffscreenImages()
+//
+// PROPSITO: Equivalente a recreateSwapChain() sin ventana: el tamao no cambia, pero
+//            hay una imagen por fotograma en vuelo y su nmero puede haber cambiado.
+//            Las imgenes, la profundidad y los framebuffers anteriores pasan a la
+//            cola de destruccin.
+//
+void CAVulkanState::recreateOffscreenImages()
+{
+	std::vector<VkImage> oldImages = swapChainImages;
+	std::vector<VkDeviceMemory> oldMemories = offscreenMemories;
+	std::vector<VkImageView> oldImageViews = swapChainImageViews;
+	std::vector<VkFramebuffer> oldFramebuffers = swapChainFramebuffers;
+	VkImage oldDepthImage = depthImage;
+	VkDeviceMemory oldDepthMemory = depthImageMemory;
+	VkImageView oldDepthView = depthImageView;
+	deletionQueue.push(submittedValue, [device = device, oldImages, oldMemories, oldImageViews, oldFramebuffers, oldDepthImage, oldDepthMemory, oldDepthView]() {
+		for (size_t i = 0; i < oldImages.size(); i++)
+		{
+			vkDestroyFramebuffer(device, oldFramebuffers[i], nullptr);
+			vkDestroyImageView(device, oldImageViews[i], nullptr);
+			vkDestroyImage(device, oldImages[i], nullptr);
+			vkFreeMemory(device, oldMemories[i], nullptr);
+		}
+		vkDestroyImageView(device, oldDepthView, nullptr);
+		vkFreeMemory(device, oldDepthMemory, nullptr);
+		vkDestroyImage(device, oldDepthImage, nullptr);
+	});
+
+	createOffscreenImages();
+	createImageViews();
+	createDepthBuffer();
+	createFramebuffers();
+
+	primaryPartitions.assign(frameCount, UINT32_MAX);
+	primaryImages.assign(frameCount, UINT32_MAX);
+	recordGeneration++;
+}
+
+//
+// FUNCIN: CAVulkanState::createFrameResources()
+//
+// PROPSITO: Crea los recursos que se replican por fotograma en vuelo: objetos de
+//            sincronizacin, command buffers, pools de grabacin y de descriptor sets
+//            de un fotograma, lista de dibujo y uniform de la escena
+//
+void CAVulkanState::createFrameResources()
+{
+	createSyncObjects();
 	createCommandBuffers();
-	fillCommandBuffers();
+	createFrameDescriptors();
+	createDrawList(drawCapacity, instanceCapacity, paletteCapacity);
+	createSceneUniform();
+	createRecordPools();
+}
+
+//
+// FUNCIN: CAVulkanState::destroyFrameResources()
+//
+// PROPSITO: Destruye los recursos de cada fotograma en vuelo. La GPU no debe estar
+//            usndolos.
+//
+void CAVulkanState::destroyFrameResources()
+{
+	destroyRecordPools();
+	destroySceneUniform();
+	destroyDrawList();
+	destroyFrameDescriptors();
+	vkFreeCommandBuffers(device, commandPool, frameCount, commandBuffers.data());
+	destroySyncObjects();
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -1167,7 +2149,7 @@ void CAVulkanState::createPipelineVertexInputStateCreateInfo(VkPipelineVertexInp
 	bindingDescriptions[0].stride = sizeof(CAVertex);
 	bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-	attributeDescriptions = (VkVertexInputAttributeDescription*)malloc(2 * sizeof(VkVertexInputAttributeDescription));
+	attributeDescriptions = (VkVertexInputAttributeDescription*)malloc(4 * sizeof(VkVertexInputAttributeDescription));
 	attributeDescriptions[0] = {};
 	attributeDescriptions[0].binding = 0;
 	attributeDescriptions[0].location = 0;
@@ -1180,10 +2162,22 @@ void CAVulkanState::createPipelineVertexInputStateCreateInfo(VkPipelineVertexInp
 	attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
 	attributeDescriptions[1].offset = offsetof(CAVertex, norm);
 
+	attributeDescriptions[2] = {};
+	attributeDescriptions[2].binding = 0;
+	attributeDescriptions[2].location = 2;
+	attributeDescriptions[2].format = VK_FORMAT_R32_UINT;
+	attributeDescriptions[2].offset = offsetof(CAVertex, joint);
+
+	attributeDescriptions[3] = {};
+	attributeDescriptions[3].binding = 0;
+	attributeDescriptions[3].location = 3;
+	attributeDescriptions[3].format = VK_FORMAT_R32_UINT;
+	attributeDescriptions[3].offset = offsetof(CAVertex, material);
+
 	*vertexInputInfo = {};
 	vertexInputInfo->sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 	vertexInputInfo->vertexBindingDescriptionCount = 1;
-	vertexInputInfo->vertexAttributeDescriptionCount = 2;
+	vertexInputInfo->vertexAttributeDescriptionCount = 4;
 	vertexInputInfo->pVertexBindingDescriptions = bindingDescriptions;
 	vertexInputInfo->pVertexAttributeDescriptions = attributeDescriptions;
 }
@@ -1205,28 +2199,34 @@ void CAVulkanState::createPipelineInputAssemblyStateCreateInfo(VkPipelineInputAs
 //
 // FUNCIN: CAVulkanState::createPipelineViewportStateCreateInfo()
 //
-// PROPSITO: Crea la informacin del viewport
+// PROPSITO: Crea la informacin del viewport. El viewport y el scissor son estado
+//            dinmico, as que el pipeline no depende del tamao de la ventana.
 //
-void CAVulkanState::createPipelineViewportStateCreateInfo(VkPipelineViewportStateCreateInfo* viewportState, VkViewport* viewport, VkRect2D* scissor)
+void CAVulkanState::createPipelineViewportStateCreateInfo(VkPipelineViewportStateCreateInfo* viewportState)
 {
-	*viewport = {};
-	viewport->x = 0.0f;
-	viewport->y = 0.0f;
-	viewport->width = (float)swapChainExtent.width;
-	viewport->height = (float)swapChainExtent.height;
-	viewport->minDepth = 0.0f;
-	viewport->maxDepth = 1.0f;
-
-	*scissor = {};
-	scissor->offset = { 0, 0 };
-	scissor->extent = swapChainExtent;
-
 	*viewportState = {};
 	viewportState->sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState->viewportCount = 1;
-	viewportState->pViewports = viewport;
+	viewportState->pViewports = nullptr;
 	viewportState->scissorCount = 1;
-	viewportState->pScissors = scissor;
+	viewportState->pScissors = nullptr;
+}
+
+//
+// FUNCIN: CAVulkanState::createPipelineDynamicStateCreateInfo()
+//
+// PROPSITO: Crea la informacin del estado dinmico: viewport y scissor se fijan al
+//            grabar cada command buffer con el tamao actual de la swapchain
+//
+void CAVulkanState::createPipelineDynamicStateCreateInfo(VkPipelineDynamicStateCreateInfo* dynamicState, VkDynamicState* dynamicStates)
+{
+	dynamicStates[0] = VK_DYNAMIC_STATE_VIEWPORT;
+	dynamicStates[1] = VK_DYNAMIC_STATE_SCISSOR;
+
+	*dynamicState = {};
+	dynamicState->sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState->dynamicStateCount = 2;
+	dynamicState->pDynamicStates = dynamicStates;
 }
 
 //
@@ -1303,77 +2303,1046 @@ void CAVulkanState::createPipelineColorBlendStateCreateInfo(VkPipelineColorBlend
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 /////                                                                                 /////
-/////                       Mtodos de generacin de la imagen                        /////
+/////                       Mtodos de subida de la geometra                         /////
 /////                                                                                 /////
 ///////////////////////////////////////////////////////////////////////////////////////////
 
 //
-// FUNCIN: CAVulkanState::waitForNextImage()
+// FUNCIN: CAVulkanState::createStagingRing()
 //
-// PROPSITO: Espera hasta que la prxima imagen est lista para ser generada
+// PROPSITO: Crea el anillo de staging y el pool de los command buffers de copia.
+//            En GPUs integradas o de CPU la memoria es compartida y la geometra
+//            se escribe directamente en memoria visible desde el host; el anillo
+//            se usa igualmente para los datos que cambian mientras se dibuja.
 //
-void CAVulkanState::waitForNextImage()
+void CAVulkanState::createStagingRing()
 {
-	vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	stagedGeometry = deviceProperties.deviceType != VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU
+		&& deviceProperties.deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU;
 
-	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
-	currentImage = imageIndex;
+	stagingBuffer = VK_NULL_HANDLE;
+	stagingMemory = {};
+	stagingData = nullptr;
+	stagingSize = 0;
+	stagingHead = 0;
+	stagingBatchBegin = 0;
 
-	if (result == VK_ERROR_OUT_OF_DATE_KHR)
-	{
-		recreateSwapChain();
-	}
-	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+	createStagingBuffer(STAGING_RING_SIZE);
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = graphicsQueueFamilyIndex;
+
+	if (vkCreateCommandPool(device, &poolInfo, nullptr, &uploadCommandPool) != VK_SUCCESS)
 	{
-		throw std::runtime_error("failed to acquire swap chain image!");
+		throw std::runtime_error("failed to create upload command pool!");
 	}
 }
 
 //
-// FUNCIN: CAVulkanState::submitGraphicsCommands()
+// FUNCIN: CAVulkanState::destroyStagingRing()
 //
-// PROPSITO: Enva los comandos grficos al dispositivo
+// PROPSITO: Destruye el anillo de staging esperando a la ltima copia enviada
 //
-void CAVulkanState::submitGraphicsCommands()
+void CAVulkanState::destroyStagingRing()
 {
-	if (imagesInFlight[currentImage] != VK_NULL_HANDLE)
-	{
-		vkWaitForFences(device, 1, &imagesInFlight[currentImage], VK_TRUE, UINT64_MAX);
-	}
-	imagesInFlight[currentImage] = inFlightFences[currentFrame];
-
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers[currentImage];
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
-
-	vkResetFences(device, 1, &inFlightFences[currentFrame]);
-
-	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
+	waitForUploads();
+	if (!uploadCommandBuffers.empty())
 	{
-		throw std::runtime_error("failed to submit draw command buffer!");
+		vkFreeCommandBuffers(device, uploadCommandPool, (uint32_t)uploadCommandBuffers.size(), uploadCommandBuffers.data());
 	}
+	uploadCommandBuffers.clear();
+	vkDestroyCommandPool(device, uploadCommandPool, nullptr);
+	vkDestroyBuffer(device, stagingBuffer, nullptr);
+	allocator->free(stagingMemory);
 }
 
 //
-// FUNCIN: CAVulkanState::submitPresentCommands()
+// FUNCIN: CAVulkanState::createStagingBuffer(VkDeviceSize size)
 //
-// PROPSITO: Enva los comandos de presentacin al dispositivo
+// PROPSITO: Crea el buffer de staging. La memoria se deja mapeada durante toda
+//            la vida del buffer.
 //
-void CAVulkanState::submitPresentCommands()
+void CAVulkanState::createStagingBuffer(VkDeviceSize size)
 {
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-	VkSwapchainKHR swapChains[] = { swapChain };
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(device, &bufferInfo, nullptr, &stagingBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create staging buffer!");
+	}
+
+	stagingMemory = allocator->allocateBuffer(stagingBuffer, CA_MEMORY_STAGING);
+	stagingData = stagingMemory.mapped;
+	stagingSize = size;
+	stagingHead = 0;
+	stagingBatchBegin = 0;
+}
+
+//
+// FUNCIN: CAVulkanState::createGeometryArena(uint32_t vertexCapacity, uint32_t indexCapacity)
+//
+// PROPSITO: Crea los buffers comunes de vrtices e ndices y sube la geometra que
+//            ya estuviera registrada. Si la geometra se sube por staging quedan en
+//            memoria local del dispositivo; si no, en memoria visible desde el host.
+//
+void CAVulkanState::createGeometryArena(uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+	recordGeneration++;
+	this->vertexCapacity = vertexCapacity;
+	this->indexCapacity = indexCapacity;
+
+	VkBufferUsageFlags transferUsage = stagedGeometry ? VK_BUFFER_USAGE_TRANSFER_DST_BIT : 0;
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = vertexCapacity * sizeof(CAVertex);
+	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | transferUsage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(device, &bufferInfo, nullptr, &geometryVertexBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create buffer!");
+	}
+
+	bufferInfo.size = indexCapacity * sizeof(uint16_t);
+	bufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | transferUsage;
+
+	if (vkCreateBuffer(device, &bufferInfo, nullptr, &geometryIndexBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create buffer!");
+	}
+
+	// En memoria unificada se prefiere la que es a la vez local y visible desde el host
+	CAMemoryUsage usage = stagedGeometry ? CA_MEMORY_GPU_ONLY : CA_MEMORY_CPU_TO_GPU;
+	geometryVertexMemory = allocator->allocateBuffer(geometryVertexBuffer, usage);
+	geometryIndexMemory = allocator->allocateBuffer(geometryIndexBuffer, usage);
+
+	if (!geometryVertices.empty())
+	{
+		writeGeometry(geometryVertexBuffer, geometryVertexMemory, 0, geometryVertices.size() * sizeof(CAVertex), geometryVertices.data());
+		writeGeometry(geometryIndexBuffer, geometryIndexMemory, 0, geometryIndices.size() * sizeof(uint16_t), geometryIndices.data());
+	}
+}
+
+//
+// FUNCIN: CAVulkanState::writeGeometry(VkBuffer dst, const CAAllocation& memory, VkDeviceSize dstOffset, size_t size, const void* data)
+//
+// PROPSITO: Escribe datos en un buffer comn de geometra. Con staging la copia se
+//            aade al lote pendiente; si no, se escriben directamente en la memoria
+//            mapeada (ningn fotograma en vuelo lee los huecos que se rellenan) y, si
+//            no es coherente, el rango se anota para volcarlo antes del envo.
+//
+void CAVulkanState::writeGeometry(VkBuffer dst, const CAAllocation& memory, VkDeviceSize dstOffset, size_t size, const void* data)
+{
+	if (size == 0) return;
+
+	if (stagedGeometry)
+	{
+		stageCopy(dst, dstOffset, size, data);
+		return;
+	}
+
+	memcpy(memory.mapped + dstOffset, data, size);
+
+	if (!memory.coherent)
+	{
+		// La reserva est alineada a nonCoherentAtomSize; se vuelca entera
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = memory.memory;
+		range.offset = memory.offset;
+		range.size = memory.size;
+		mappedRanges.push_back(range);
+	}
+}
+
+//
+// FUNCIN: CAVulkanState::destroyGeometryArena()
+//
+// PROPSITO: Destruye los buffers comunes de vrtices e ndices cuando terminen los
+//            fotogramas que pueden usarlos
+//
+void CAVulkanState::destroyGeometryArena()
+{
+	VkBuffer vertexBuffer = geometryVertexBuffer;
+	VkBuffer indexBuffer = geometryIndexBuffer;
+	CAAllocation vertexMemory = geometryVertexMemory;
+	CAAllocation indexMemory = geometryIndexMemory;
+	deferDestroy([this, vertexBuffer, indexBuffer, vertexMemory, indexMemory]() mutable {
+		vkDestroyBuffer(device, vertexBuffer, nullptr);
+		allocator->free(vertexMemory);
+		vkDestroyBuffer(device, indexBuffer, nullptr);
+		allocator->free(indexMemory);
+	});
+}
+
+//
+// FUNCIN: CAVulkanState::resizeGeometryArena(uint32_t vertexCapacity, uint32_t indexCapacity)
+//
+// PROPSITO: Sustituye los buffers comunes por otros mayores. Se vuelve a subir toda
+//            la geometra desde la copia que se guarda en memoria del host.
+//
+void CAVulkanState::resizeGeometryArena(uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+	// Las copias pendientes al buffer anterior se envan antes de retirarlo
+	flushUploads();
+	destroyGeometryArena();
+	createGeometryArena(vertexCapacity, indexCapacity);
+}
+
+//
+// FUNCIN: CAVulkanState::stageCopy(VkBuffer dst, VkDeviceSize dstOffset, size_t size, const void* data)
+//
+// PROPSITO: Copia los datos al anillo de staging y aade la copia al lote pendiente
+//
+void CAVulkanState::stageCopy(VkBuffer dst, VkDeviceSize dstOffset, size_t size, const void* data)
+{
+	if (size == 0) return;
+
+	VkDeviceSize offset = allocateStaging(size);
+	if (uploadRegions.empty()) stagingBatchBegin = offset;
+	memcpy(stagingData + offset, data, size);
+
+	VkBufferCopy region = {};
+	region.srcOffset = offset;
+	region.dstOffset = dstOffset;
+	region.size = size;
+	uploadTargets.push_back(dst);
+	uploadRegions.push_back(region);
+	stagingHead = offset + size;
+}
+
+//
+// FUNCIN: CAVulkanState::allocateStaging(VkDeviceSize size)
+//
+// PROPSITO: Busca sitio en el anillo a continuacin de stagingHead, volviendo al
+//            principio si no cabe al final. La parte ocupada empieza en el lote
+//            enviado ms antiguo que no ha terminado (o en el lote pendiente). Slo
+//            si el hueco no basta se enva lo pendiente y se espera al lote ms
+//            antiguo; si los datos son mayores que el anillo vaco, ste se agranda.
+//
+VkDeviceSize CAVulkanState::allocateStaging(VkDeviceSize size)
+{
+	for (;;)
+	{
+		retireUploads();
+
+		if (uploadBatches.empty() && uploadRegions.empty())
+		{
+			stagingHead = 0;
+			if (size <= stagingSize) return 0;
+
+			// Ningn lote usa el buffer actual: se puede destruir ya
+			vkDestroyBuffer(device, stagingBuffer, nullptr);
+			allocator->free(stagingMemory);
+			createStagingBuffer(std::max(size, 2 * stagingSize));
+			continue;
+		}
+
+		VkDeviceSize tail = uploadBatches.empty() ? stagingBatchBegin : uploadBatches.front().begin;
+		VkDeviceSize offset = (stagingHead + STAGING_ALIGNMENT - 1) & ~(VkDeviceSize)(STAGING_ALIGNMENT - 1);
+		if (stagingHead >= tail)
+		{
+			if (offset + size <= stagingSize) return offset;
+			if (size < tail) return 0;
+		}
+		else if (offset + size < tail)
+		{
+			return offset;
+		}
+
+		flushUploads();
+		waitForValue(uploadBatches.front().value);
+	}
+}
+
+//
+// FUNCIN: CAVulkanState::retireUploads()
+//
+// PROPSITO: Libera el tramo del anillo y el command buffer de los lotes que ya han
+//            terminado, sin esperar a los dems
+//
+void CAVulkanState::retireUploads()
+{
+	if (!uploadBatches.empty() && uploadBatches.front().value > completedValue)
+	{
+		uint64_t reached;
+		vkGetSemaphoreCounterValue(device, timeline, &reached);
+		completedValue = std::max(completedValue, reached);
+	}
+
+	while (!uploadBatches.empty() && uploadBatches.front().value <= completedValue)
+	{
+		uploadCommandBuffers.push_back(uploadBatches.front().commandBuffer);
+		uploadBatches.pop_front();
+	}
+}
+
+//
+// FUNCIN: CAVulkanState::flushUploads()
+//
+// PROPSITO: Enva en un nico command buffer todas las copias pendientes, con una
+//            barrera que las hace visibles a la entrada de vrtices y a los shaders. No espera
+//            al envo: el orden de la cola y la barrera bastan para los dibujos
+//            posteriores. El lote guarda su valor del timeline, que slo se espera
+//            si el anillo se llena hasta su tramo.
+//
+void CAVulkanState::flushUploads()
+{
+	if (uploadRegions.empty()) return;
+
+	if (!stagingMemory.coherent)
+	{
+		// El lote puede dar la vuelta al anillo: se vuelcan uno o dos tramos
+		VkDeviceSize atom = allocator->getNonCoherentAtomSize();
+		VkMappedMemoryRange ranges[2] = {};
+		uint32_t rangeCount = 0;
+		VkDeviceSize begin[2] = { stagingBatchBegin, 0 };
+		VkDeviceSize end[2] = { stagingHead, 0 };
+		if (stagingHead < stagingBatchBegin)
+		{
+			end[0] = stagingSize;
+			end[1] = stagingHead;
+		}
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			if (end[i] <= begin[i]) continue;
+			VkDeviceSize first = begin[i] / atom * atom;
+			ranges[rangeCount].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			ranges[rangeCount].memory = stagingMemory.memory;
+			ranges[rangeCount].offset = stagingMemory.offset + first;
+			ranges[rangeCount].size = std::min(stagingMemory.size, (end[i] + atom - 1) / atom * atom) - first;
+			rangeCount++;
+		}
+		vkFlushMappedMemoryRanges(device, rangeCount, ranges);
+	}
+
+	VkCommandBuffer uploadCommandBuffer;
+	if (uploadCommandBuffers.empty())
+	{
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = uploadCommandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(device, &allocInfo, &uploadCommandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate upload command buffer!");
+		}
+	}
+	else
+	{
+		uploadCommandBuffer = uploadCommandBuffers.back();
+		uploadCommandBuffers.pop_back();
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (vkBeginCommandBuffer(uploadCommandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to begin recording upload command buffer!");
+	}
+
+	// Las copias pueden sobrescribir datos que leen los fotogramas ya enviados
+	vkCmdPipelineBarrier(uploadCommandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	for (size_t i = 0; i < uploadRegions.size(); i++)
+	{
+		vkCmdCopyBuffer(uploadCommandBuffer, stagingBuffer, uploadTargets[i], 1, &uploadRegions[i]);
+	}
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(uploadCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	if (vkEndCommandBuffer(uploadCommandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record upload command buffer!");
+	}
+
+	uint64_t signalValue = submittedValue + 1;
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &uploadCommandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &timeline;
+
+	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit upload command buffer!");
+	}
+
+	submittedValue = signalValue;
+
+	CAUploadBatch batch;
+	batch.begin = stagingBatchBegin;
+	batch.value = signalValue;
+	batch.commandBuffer = uploadCommandBuffer;
+	uploadBatches.push_back(batch);
+	stagingBatchBegin = stagingHead;
+	uploadTargets.clear();
+	uploadRegions.clear();
+}
+
+//
+// FUNCIN: CAVulkanState::flushMappedRanges()
+//
+// PROPSITO: Vuelca con una sola llamada los rangos de memoria no coherente escritos
+//            en el fotograma, uniendo antes los rangos contiguos del mismo bloque
+//
+void CAVulkanState::flushMappedRanges()
+{
+	if (mappedRanges.empty()) return;
+
+	std::sort(mappedRanges.begin(), mappedRanges.end(), [](const VkMappedMemoryRange& a, const VkMappedMemoryRange& b) {
+		if (a.memory != b.memory) return a.memory < b.memory;
+		return a.offset < b.offset;
+	});
+
+	size_t count = 0;
+	for (size_t i = 1; i < mappedRanges.size(); i++)
+	{
+		VkMappedMemoryRange& last = mappedRanges[count];
+		if (mappedRanges[i].memory == last.memory && mappedRanges[i].offset <= last.offset + last.size)
+		{
+			last.size = std::max(last.size, mappedRanges[i].offset + mappedRanges[i].size - last.offset);
+		}
+		else
+		{
+			mappedRanges[++count] = mappedRanges[i];
+		}
+	}
+	count++;
+
+	if (vkFlushMappedMemoryRanges(device, (uint32_t)count, mappedRanges.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to flush mapped memory ranges!");
+	}
+	mappedRanges.clear();
+}
+
+//
+// FUNCIN: CAVulkanState::waitForUploads()
+//
+// PROPSITO: Espera a que terminen todos los lotes de copias enviados
+//
+void CAVulkanState::waitForUploads()
+{
+	if (uploadBatches.empty()) return;
+
+	waitForValue(uploadBatches.back().value);
+	retireUploads();
+}
+
+//
+// FUNCIN: CAVulkanState::allocateGeometryRange(std::vector<CAGeometryRange>& ranges, uint32_t count)
+//
+// PROPSITO: Busca el primer hueco libre de los buffers comunes con sitio para count
+//            elementos y lo reserva. Devuelve UINT32_MAX si no hay ninguno.
+//
+uint32_t CAVulkanState::allocateGeometryRange(std::vector<CAGeometryRange>& ranges, uint32_t count)
+{
+	for (size_t i = 0; i < ranges.size(); i++)
+	{
+		if (ranges[i].count < count) continue;
+
+		uint32_t first = ranges[i].first;
+		ranges[i].first += count;
+		ranges[i].count -= count;
+		if (ranges[i].count == 0) ranges.erase(ranges.begin() + i);
+		return first;
+	}
+	return UINT32_MAX;
+}
+
+//
+// FUNCIN: CAVulkanState::freeGeometryRange(std::vector<CAGeometryRange>& ranges, uint32_t first, uint32_t count)
+//
+// PROPSITO: Devuelve un hueco a la lista de libres, ordenada por posicin, unindolo
+//            con los huecos contiguos
+//
+void CAVulkanState::freeGeometryRange(std::vector<CAGeometryRange>& ranges, uint32_t first, uint32_t count)
+{
+	if (count == 0) return;
+
+	size_t i = 0;
+	while (i < ranges.size() && ranges[i].first < first) i++;
+	ranges.insert(ranges.begin() + i, { first, count });
+
+	if (i + 1 < ranges.size() && ranges[i].first + ranges[i].count == ranges[i + 1].first)
+	{
+		ranges[i].count += ranges[i + 1].count;
+		ranges.erase(ranges.begin() + i + 1);
+	}
+	if (i > 0 && ranges[i - 1].first + ranges[i - 1].count == ranges[i].first)
+	{
+		ranges[i - 1].count += ranges[i].count;
+		ranges.erase(ranges.begin() + i);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+/////                                                                                 /////
+/////                       Mtodos de gestin de descriptores                        /////
+/////                                                                                 /////
+///////////////////////////////////////////////////////////////////////////////////////////
+
+//
+// FUNCIN: CAVulkanState::createDescriptorAllocators()
+//
+// PROPSITO: Crea el asignador global de descriptor sets, cuyos sets viven hasta que
+//            se liberan, y uno por fotograma en vuelo para los sets de ese fotograma
+//
+void CAVulkanState::createDescriptorAllocators()
+{
+	descriptors = new CADescriptorAllocator(device, true);
+	createFrameDescriptors();
+}
+
+//
+// FUNCIN: CAVulkanState::destroyDescriptorAllocators()
+//
+// PROPSITO: Destruye los asignadores de descriptor sets
+//
+void CAVulkanState::destroyDescriptorAllocators()
+{
+	destroyFrameDescriptors();
+	descriptorCache.clear();
+	delete descriptors;
+}
+
+//
+// FUNCIN: CAVulkanState::createFrameDescriptors()
+//
+// PROPSITO: Crea un asignador de descriptor sets por fotograma en vuelo. Los sets
+//            de cada fotograma se crean en su primer dibujo.
+//
+void CAVulkanState::createFrameDescriptors()
+{
+	frameDescriptors.resize(frameCount);
+	for (uint32_t i = 0; i < frameCount; i++)
+	{
+		frameDescriptors[i] = new CADescriptorAllocator(device, false);
+	}
+	sceneSets.assign(frameCount, VK_NULL_HANDLE);
+	instanceSets.assign(frameCount, VK_NULL_HANDLE);
+	frameSetGenerations.assign(frameCount, 0);
+}
+
+//
+// FUNCIN: CAVulkanState::destroyFrameDescriptors()
+//
+// PROPSITO: Destruye los asignadores de cada fotograma en vuelo junto con sus sets
+//
+void CAVulkanState::destroyFrameDescriptors()
+{
+	for (size_t i = 0; i < frameDescriptors.size(); i++)
+	{
+		delete frameDescriptors[i];
+	}
+	frameDescriptors.clear();
+}
+
+//
+// FUNCIN: CAVulkanState::writeDescriptorSet(VkDescriptorSet set, VkDescriptorType type, const std::vector<VkDescriptorBufferInfo>& buffers)
+//
+// PROPSITO: Escribe los buffers en los bindings consecutivos desde el 0 de un set
+//
+void CAVulkanState::writeDescriptorSet(VkDescriptorSet set, VkDescriptorType type, const std::vector<VkDescriptorBufferInfo>& buffers)
+{
+	// Una escritura por binding: los bindings pueden diferir en las etapas que los usan
+	std::vector<VkWriteDescriptorSet> descriptorWrites(buffers.size());
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		descriptorWrites[i] = {};
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = set;
+		descriptorWrites[i].dstBinding = (uint32_t)i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = type;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pBufferInfo = &buffers[i];
+	}
+	vkUpdateDescriptorSets(device, (uint32_t)descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+}
+
+//
+// FUNCIN: CAVulkanState::allocateFrameDescriptorSet(VkDescriptorSetLayout layout)
+//
+// PROPSITO: Reserva un descriptor set en el pool del fotograma actual. Vive hasta
+//            que se rehacen los sets del fotograma.
+//
+VkDescriptorSet CAVulkanState::allocateFrameDescriptorSet(VkDescriptorSetLayout layout)
+{
+	return frameDescriptors[currentFrame]->allocate(layout);
+}
+
+//
+// FUNCIN: CAVulkanState::updateFrameDescriptorSets()
+//
+// PROPSITO: Rehace los sets de la escena (set 0) y de la lista de dibujo (set 2) del
+//            fotograma actual si desde la ltima vez se ha recreado algn recurso
+//            enlazado (recordGeneration). Basta un reset del pool del fotograma: su
+//            envo anterior ya ha terminado, y los dems fotogramas en vuelo
+//            conservan sus propios sets y buffers (cuya destruccin se difiere).
+//
+void CAVulkanState::updateFrameDescriptorSets()
+{
+	if (frameSetGenerations[currentFrame] == recordGeneration) return;
+
+	frameDescriptors[currentFrame]->reset();
+
+	std::vector<VkDescriptorBufferInfo> sceneInfo(1);
+	sceneInfo[0].buffer = sceneBuffer.buffers[currentFrame];
+	sceneInfo[0].offset = 0;
+	sceneInfo[0].range = sizeof(CASceneInfo);
+	sceneSets[currentFrame] = allocateFrameDescriptorSet(sceneSetLayout);
+	writeDescriptorSet(sceneSets[currentFrame], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, sceneInfo);
+
+	std::vector<VkDescriptorBufferInfo> instanceInfo(2);
+	instanceInfo[0].buffer = instanceBuffer.buffers[currentFrame];
+	instanceInfo[0].offset = 0;
+	instanceInfo[0].range = VK_WHOLE_SIZE;
+	instanceInfo[1].buffer = paletteBuffer.buffers[currentFrame];
+	instanceInfo[1].offset = 0;
+	instanceInfo[1].range = VK_WHOLE_SIZE;
+	instanceSets[currentFrame] = allocateFrameDescriptorSet(instanceSetLayout);
+	writeDescriptorSet(instanceSets[currentFrame], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, instanceInfo);
+
+	frameSetGenerations[currentFrame] = recordGeneration;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+/////                                                                                 /////
+/////                       Mtodos de la lista de dibujo                             /////
+/////                                                                                 /////
+///////////////////////////////////////////////////////////////////////////////////////////
+
+//
+// FUNCIN: CAVulkanState::createDrawList(uint32_t drawCapacity, uint32_t instanceCapacity, uint32_t paletteCapacity)
+//
+// PROPSITO: Crea, para cada fotograma, el buffer de comandos de dibujo indirecto y
+//            los storage buffers de instancias y de la paleta (set 2), todos escritos
+//            desde el host en cada fotograma. Su descriptor set se crea en el pool del
+//            fotograma (updateFrameDescriptorSets).
+//
+void CAVulkanState::createDrawList(uint32_t drawCapacity, uint32_t instanceCapacity, uint32_t paletteCapacity)
+{
+	recordGeneration++;
+	this->drawCapacity = drawCapacity;
+	this->instanceCapacity = instanceCapacity;
+	this->paletteCapacity = paletteCapacity;
+
+	createFrameBuffers(drawCapacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, &drawBuffer);
+	createFrameBuffers(instanceCapacity * sizeof(CAInstance), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &instanceBuffer);
+	createFrameBuffers(paletteCapacity * sizeof(glm::mat4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &paletteBuffer);
+}
+
+//
+// FUNCIN: CAVulkanState::destroyDrawList()
+//
+// PROPSITO: Destruye los buffers de la lista de dibujo. Los sets que los enlazan
+//            siguen en los pools de los fotogramas en vuelo hasta que se rehacen.
+//
+void CAVulkanState::destroyDrawList()
+{
+	destroyUniformBuffer(drawBuffer);
+	destroyUniformBuffer(instanceBuffer);
+	destroyUniformBuffer(paletteBuffer);
+}
+
+//
+// FUNCIN: CAVulkanState::uploadDraws()
+//
+// PROPSITO: Escribe la lista de dibujo del fotograma en los buffers de la imagen
+//            actual. El nmero de dibujos queda grabado en los command buffers (y
+//            sin dibujo indirecto, tambin los parmetros de cada uno), as que si
+//            cambia hay que volver a grabarlos.
+//
+void CAVulkanState::uploadDraws()
+{
+	if (drawCommands.size() > drawCapacity || drawInstances.size() > instanceCapacity || drawPalette.size() > paletteCapacity)
+	{
+		uint32_t newDrawCapacity = drawCapacity;
+		uint32_t newInstanceCapacity = instanceCapacity;
+		uint32_t newPaletteCapacity = paletteCapacity;
+		while (newDrawCapacity < drawCommands.size()) newDrawCapacity *= 2;
+		while (newInstanceCapacity < drawInstances.size()) newInstanceCapacity *= 2;
+		while (newPaletteCapacity < drawPalette.size()) newPaletteCapacity *= 2;
+
+		destroyDrawList();
+		createDrawList(newDrawCapacity, newInstanceCapacity, newPaletteCapacity);
+	}
+
+	if (!drawCommands.empty())
+	{
+		updateUniformBuffer(drawCommands.size() * sizeof(VkDrawIndexedIndirectCommand), drawCommands.data(), drawBuffer);
+		updateUniformBuffer(drawInstances.size() * sizeof(CAInstance), drawInstances.data(), instanceBuffer);
+	}
+	if (!drawPalette.empty())
+	{
+		updateUniformBuffer(drawPalette.size() * sizeof(glm::mat4), drawPalette.data(), paletteBuffer);
+	}
+}
+
+//
+// FUNCIN: CAVulkanState::addDrawCommands(VkCommandBuffer commandBuffer, uint32_t index, uint32_t firstDraw, uint32_t drawCount)
+//
+// PROPSITO: Aade los dibujos [firstDraw, firstDraw + drawCount) de la lista al command
+//            buffer de la imagen index. Toda la geometra est en los buffers comunes,
+//            que se enlazan una sola vez. Con multiDrawIndirect basta un nico
+//            vkCmdDrawIndexedIndirect para todo el rango.
+//
+void CAVulkanState::addDrawCommands(VkCommandBuffer commandBuffer, uint32_t index, uint32_t firstDraw, uint32_t drawCount)
+{
+	if (drawCount == 0) return;
+
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &geometryVertexBuffer, &offset);
+	vkCmdBindIndexBuffer(commandBuffer, geometryIndexBuffer, 0, VK_INDEX_TYPE_UINT16);
+
+	uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	if (!indirectDraws)
+	{
+		for (uint32_t i = firstDraw; i < firstDraw + drawCount; i++)
+		{
+			const VkDrawIndexedIndirectCommand& draw = drawCommands[i];
+			vkCmdDrawIndexed(commandBuffer, draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+		}
+	}
+	else if (multiDrawIndirect)
+	{
+		vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer.buffers[index], firstDraw * stride, drawCount, stride);
+	}
+	else
+	{
+		for (uint32_t i = firstDraw; i < firstDraw + drawCount; i++)
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer.buffers[index], i * stride, 1, stride);
+		}
+	}
+}
+
+//
+// FUNCIN: CAVulkanState::createSceneUniform()
+//
+// PROPSITO: Crea el uniform buffer de la escena para cada fotograma. Su descriptor
+//            set (set 0) se crea en el pool del fotograma y se enlaza una sola vez al
+//            principio de cada command buffer.
+//
+void CAVulkanState::createSceneUniform()
+{
+	recordGeneration++;
+	createUniformBuffer(sizeof(CASceneInfo), &sceneBuffer);
+}
+
+//
+// FUNCIN: CAVulkanState::destroySceneUniform()
+//
+// PROPSITO: Destruye el uniform buffer de la escena
+//
+void CAVulkanState::destroySceneUniform()
+{
+	destroyUniformBuffer(sceneBuffer);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+/////                                                                                 /////
+/////                          Mtodos de la tabla de materiales                      /////
+/////                                                                                 /////
+///////////////////////////////////////////////////////////////////////////////////////////
+
+//
+// FUNCIN: CAVulkanState::createMaterialTable(uint32_t capacity)
+//
+// PROPSITO: Crea el storage buffer de la tabla de materiales en memoria local del
+//            dispositivo y su descriptor set. Los datos se suben por el anillo de staging.
+//
+void CAVulkanState::createMaterialTable(uint32_t capacity)
+{
+	recordGeneration++;
+	materialCapacity = capacity;
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = capacity * sizeof(CAMaterial);
+	bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(device, &bufferInfo, nullptr, &materialBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create buffer!");
+	}
+
+	materialMemory = allocator->allocateBuffer(materialBuffer, CA_MEMORY_GPU_ONLY);
+
+	std::vector<VkDescriptorBufferInfo> buffersInfo(1);
+	buffersInfo[0].buffer = materialBuffer;
+	buffersInfo[0].offset = 0;
+	buffersInfo[0].range = VK_WHOLE_SIZE;
+
+	materialSet = getDescriptorSet(materialSetLayout, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffersInfo);
+	materialsDirty = true;
+}
+
+//
+// FUNCIN: CAVulkanState::destroyMaterialTable()
+//
+// PROPSITO: Destruye el storage buffer de la tabla de materiales cuando terminen
+//            los fotogramas que pueden usarlo
+//
+void CAVulkanState::destroyMaterialTable()
+{
+	releaseDescriptorSets(materialBuffer);
+
+	VkBuffer buffer = materialBuffer;
+	CAAllocation memory = materialMemory;
+	deferDestroy([this, buffer, memory]() mutable {
+		vkDestroyBuffer(device, buffer, nullptr);
+		allocator->free(memory);
+	});
+}
+
+//
+// FUNCIN: CAVulkanState::uploadMaterials()
+//
+// PROPSITO: Sube la tabla de materiales si ha cambiado desde la ltima subida
+//
+void CAVulkanState::uploadMaterials()
+{
+	if (!materialsDirty || materials.empty()) return;
+
+	stageCopy(materialBuffer, 0, materials.size() * sizeof(CAMaterial), materials.data());
+	materialsDirty = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+/////                                                                                 /////
+/////                        Mtodos de la cach de pipelines                         /////
+/////                                                                                 /////
+///////////////////////////////////////////////////////////////////////////////////////////
+
+//
+// FUNCIN: CAVulkanState::createPipelineCache()
+//
+// PROPSITO: Crea la cach de pipelines con el contenido de PIPELINE_CACHE_FILE si
+//            el fichero se gener con el mismo dispositivo y versin del driver. En
+//            otro caso la cach empieza vaca.
+//
+void CAVulkanState::createPipelineCache()
+{
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+	std::vector<char> data;
+	std::ifstream file(PIPELINE_CACHE_FILE, std::ios::binary);
+	if (file.is_open())
+	{
+		CAPipelineCacheHeader header = {};
+		file.read((char*)&header, sizeof(header));
+		if (file.gcount() == sizeof(header)
+			&& header.magic == PIPELINE_CACHE_MAGIC
+			&& header.vendorID == deviceProperties.vendorID
+			&& header.deviceID == deviceProperties.deviceID
+			&& header.driverVersion == deviceProperties.driverVersion
+			&& memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0)
+		{
+			data.resize((size_t)header.dataSize);
+			file.read(data.data(), data.size());
+			if ((uint64_t)file.gcount() != header.dataSize) data.clear();
+		}
+	}
+
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+	{
+		// Datos rechazados por el driver: se empieza con la cach vaca
+		cacheInfo.initialDataSize = 0;
+		cacheInfo.pInitialData = nullptr;
+		if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create pipeline cache!");
+		}
+	}
+}
+
+//
+// FUNCIN: CAVulkanState::destroyPipelineCache()
+//
+// PROPSITO: Guarda el contenido de la cach de pipelines en PIPELINE_CACHE_FILE,
+//            precedido de la cabecera con la que se valida al cargarla, y la destruye
+//
+void CAVulkanState::destroyPipelineCache()
+{
+	size_t size = 0;
+	std::vector<char> data;
+	if (vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) == VK_SUCCESS && size > 0)
+	{
+		data.resize(size);
+		if (vkGetPipelineCacheData(device, pipelineCache, &size, data.data()) != VK_SUCCESS) size = 0;
+	}
+
+	if (size > 0)
+	{
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+		CAPipelineCacheHeader header = {};
+		header.magic = PIPELINE_CACHE_MAGIC;
+		header.vendorID = deviceProperties.vendorID;
+		header.deviceID = deviceProperties.deviceID;
+		header.driverVersion = deviceProperties.driverVersion;
+		memcpy(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+		header.dataSize = size;
+
+		std::ofstream file(PIPELINE_CACHE_FILE, std::ios::binary | std::ios::trunc);
+		if (file.is_open())
+		{
+			file.write((const char*)&header, sizeof(header));
+			file.write(data.data(), size);
+		}
+	}
+
+	vkDestroyPipelineCache(device, pipelineCache, nullptr);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+/////                                                                                 /////
+/////                       Mtodos de generacin de la imagen                        /////
+/////                                                                                 /////
+///////////////////////////////////////////////////////////////////////////////////////////
+
+//
+// FUNCIN: CAVulkanState::waitForNextImage()
+//
+// PROPSITO: Espera hasta que la prxima imagen est lista para ser generada
+//
+void CAVulkanState::waitForNextImage()
+{
+	// Sin ventana cada fotograma en vuelo tiene su imagen, que ya est libre
+	// porque se ha esperado a su valor del timeline
+	if (headless)
+	{
+		currentImage = currentFrame;
+		return;
+	}
+
+	// Si la swapchain ha caducado el semforo no se sealiza: se recrea y se repite
+	uint32_t imageIndex;
+	VkResult result;
+	while ((result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex)) == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		recreateSwapChain();
+	}
+	if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+	{
+		throw std::runtime_error("failed to acquire swap chain image!");
+	}
+	currentImage = imageIndex;
+
+	// Este fotograma espera a que se libere la imagen, es decir, a que termine su
+	// presentacin anterior (ver collectRetiredSwapChains)
+	for (size_t i = 0; i < retiredSwapChains.size(); i++)
+	{
+		if (retiredSwapChains[i].presentedImage == imageIndex) retiredSwapChains[i].acquired = true;
+	}
+}
+
+//
+// FUNCIN: CAVulkanState::submitGraphicsCommands()
+//
+// PROPSITO: Enva los comandos grficos al dispositivo. Adems del semforo binario
+//            que espera la presentacin, el envo sealiza en el timeline el valor
+//            del fotograma, que es lo que se espera antes de reutilizar sus recursos.
+//
+void CAVulkanState::submitGraphicsCommands()
+{
+	uint64_t signalValue = submittedValue + 1;
+
+	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
+	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame], timeline };
+	uint64_t waitValues[] = { 0 };
+	uint64_t signalValues[] = { 0, signalValue };
+
+	// Sin ventana no hay imagen que adquirir ni que presentar: slo el timeline
+	uint32_t waitCount = headless ? 0 : 1;
+	uint32_t signalCount = headless ? 1 : 2;
+	uint32_t signalFirst = headless ? 1 : 0;
+
+	// Los valores de los semforos binarios se ignoran
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = waitCount;
+	timelineInfo.pWaitSemaphoreValues = waitValues;
+	timelineInfo.signalSemaphoreValueCount = signalCount;
+	timelineInfo.pSignalSemaphoreValues = signalValues + signalFirst;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = waitCount;
+	submitInfo.pWaitSemaphores = waitSemaphores;
+	submitInfo.pWaitDstStageMask = waitStages;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+	submitInfo.signalSemaphoreCount = signalCount;
+	submitInfo.pSignalSemaphores = signalSemaphores + signalFirst;
+
+	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit draw command buffer!");
+	}
+	submittedValue = signalValue;
+	frameValues[currentFrame] = signalValue;
+}
+
+//
+// FUNCIN: CAVulkanState::submitPresentCommands()
+//
+// PROPSITO: Enva los comandos de presentacin al dispositivo. Sin ventana slo se
+//            cierra el fotograma.
+//
+void CAVulkanState::submitPresentCommands()
+{
+	if (headless)
+	{
+		measureLatency();
+		currentFrame = (currentFrame + 1) % frameCount;
+		return;
+	}
+
+	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
+	VkSwapchainKHR swapChains[] = { swapChain };
 
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1384,6 +3353,23 @@ void CAVulkanState::submitPresentCommands()
 	presentInfo.pImageIndices = &currentImage;
 
 	VkResult result = vkQueuePresentKHR(presentQueue, &presentInfo);
+	measureLatency();
+
+	// Las swapchains sustituidas anotan la primera imagen presentada despus en la
+	// nueva; la que ha vuelto a adquirirse queda ligada al valor de este fotograma
+	for (size_t i = 0; i < retiredSwapChains.size(); i++)
+	{
+		CARetiredSwapChain& retired = retiredSwapChains[i];
+		if (retired.value != 0) continue;
+		if (retired.acquired)
+		{
+			retired.value = frameValues[currentFrame];
+		}
+		else if (retired.presentedImage == UINT32_MAX && (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR))
+		{
+			retired.presentedImage = currentImage;
+		}
+	}
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
 	{
@@ -1398,6 +3384,65 @@ void CAVulkanState::submitPresentCommands()
 	currentFrame = (currentFrame + 1) % frameCount;
 }
 
+//
+// FUNCIN: CAVulkanState::limitFrameRate()
+//
+// PROPSITO: Con frameRateLimit, duerme hasta el momento de empezar el fotograma
+//            para que se presente en su plazo: el plazo menos el tiempo medio que
+//            tarda la CPU en prepararlo. Si el fotograma llega tarde se recoloca el
+//            plazo en lugar de intentar recuperar fotogramas.
+//
+void CAVulkanState::limitFrameRate()
+{
+	if (settings.frameRateLimit <= 0.0f) return;
+
+	std::chrono::steady_clock::duration period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(1.0 / settings.frameRateLimit));
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	if (nextFrameDeadline + period < now) nextFrameDeadline = now;
+	std::chrono::steady_clock::time_point wake = nextFrameDeadline - cpuFrameTime;
+	if (wake > now) std::this_thread::sleep_until(wake);
+	nextFrameDeadline += period;
+}
+
+//
+// FUNCIN: CAVulkanState::measureLatency()
+//
+// PROPSITO: Tras presentar, actualiza la media del tiempo de CPU del fotograma y, si
+//            el fotograma recoga entrada, la latencia entre el evento y la
+//            presentacin. Con reportLatency se muestra un resumen peridico.
+//
+void CAVulkanState::measureLatency()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::chrono::duration<double> frameTime = now - frameStart;
+	std::chrono::duration<double> smoothed = std::chrono::duration<double>(cpuFrameTime) * (1.0 - FRAME_TIME_SMOOTHING)
+		+ frameTime * FRAME_TIME_SMOOTHING;
+	cpuFrameTime = std::chrono::duration_cast<std::chrono::steady_clock::duration>(smoothed);
+
+	if (frameHasInput)
+	{
+		double latency = std::chrono::duration<double, std::milli>(now - frameInputTime).count();
+		latencyStats.samples++;
+		latencyStats.totalMs += latency;
+		latencyStats.maxMs = std::max(latencyStats.maxMs, latency);
+		frameHasInput = false;
+	}
+
+	if (!settings.reportLatency) return;
+	if (std::chrono::duration<double>(now - lastLatencyReport).count() < LATENCY_REPORT_PERIOD) return;
+	lastLatencyReport = now;
+
+	if (latencyStats.samples > 0)
+	{
+		std::cout << "input-to-present latency: avg " << latencyStats.totalMs / latencyStats.samples
+			<< " ms, max " << latencyStats.maxMs << " ms (" << latencyStats.samples << " frames), cpu frame "
+			<< std::chrono::duration<double, std::milli>(cpuFrameTime).count() << " ms" << std::endl;
+	}
+	latencyStats = {};
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 /////                                                                                 /////
 /////                              Mtodos auxiliares                                 /////
@@ -1418,6 +3463,23 @@ bool CAVulkanState::isDeviceSuitable(VkPhysicalDevice pDevice)
 
 	bool graphics = false;
 	bool present = false;
+
+	// Sin superficie basta con una familia grfica, que hace tambin de presentacin
+	if (headless)
+	{
+		for (uint32_t i = 0; i < queueFamilyCount && !graphics; i++)
+		{
+			if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			{
+				graphicsQueueFamilyIndex = i;
+				presentQueueFamilyIndex = i;
+				graphics = true;
+			}
+		}
+		free(queueFamilies);
+		return graphics;
+	}
+
 	for (uint32_t i = 0; i < queueFamilyCount; i++)
 	{
 		VkBool32 presentSupport = false;
@@ -1477,6 +3539,30 @@ VkSurfaceFormatKHR CAVulkanState::chooseSwapSurfaceFormat(const std::vector<VkSu
 	return availableFormats[0];
 }
 
+//
+// FUNCIN: CAVulkanState::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
+//
+// PROPSITO: Elige el modo de presentacin pedido o, si no est disponible, el ms
+//            parecido: MAILBOX e IMMEDIATE se sustituyen entre s y FIFO_RELAXED por
+//            FIFO, que siempre est disponible.
+//
+VkPresentModeKHR CAVulkanState::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
+{
+	std::vector<VkPresentModeKHR> candidates;
+	candidates.push_back(settings.presentMode);
+	if (settings.presentMode == VK_PRESENT_MODE_MAILBOX_KHR) candidates.push_back(VK_PRESENT_MODE_IMMEDIATE_KHR);
+	if (settings.presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) candidates.push_back(VK_PRESENT_MODE_MAILBOX_KHR);
+
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		if (std::find(availablePresentModes.begin(), availablePresentModes.end(), candidates[i]) != availablePresentModes.end())
+		{
+			return candidates[i];
+		}
+	}
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
 //
 // FUNCIN: CAVulkanState::chooseSwapExtent()
 //
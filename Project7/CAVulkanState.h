@@ -3,32 +3,111 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.h>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
 #include <vector>
-#include "CAVertexBuffer.h"
-#include "CAIndexBuffer.h"
 #include "CAUniformBuffer.h"
+#include "CAMemoryAllocator.h"
+#include "CADescriptorAllocator.h"
+#include "CAVertex.h"
+#include "CAMesh.h"
+#include "CAInstance.h"
+#include "CASceneInfo.h"
+#include "CAMaterial.h"
+#include "CARecordPool.h"
+#include "CAJobSystem.h"
+#include "CADeletionQueue.h"
+#include "CAPresentSettings.h"
 
 class CAModel;
 
+//
+// ESTRUCTURA: CALatencyStats
+//
+// DESCRIPCIN: Latencia medida entre un evento de entrada y la presentacin del
+//              fotograma que lo refleja
+//
+typedef struct
+{
+	uint32_t samples;
+	double totalMs;
+	double maxMs;
+} CALatencyStats;
+
+//
+// ESTRUCTURA: CAGeometryRange
+//
+// DESCRIPCIN: Hueco libre en uno de los buffers comunes de geometra (en elementos)
+//
+typedef struct
+{
+	uint32_t first;
+	uint32_t count;
+} CAGeometryRange;
+
+//
+// ESTRUCTURA: CAUploadBatch
+//
+// DESCRIPCIN: Lote de copias enviado desde el anillo de staging. Ocupa el anillo
+//              desde begin hasta el comienzo del lote siguiente, y queda libre cuando
+//              el timeline alcanza value.
+//
+typedef struct
+{
+	VkDeviceSize begin;
+	uint64_t value;
+	VkCommandBuffer commandBuffer;
+} CAUploadBatch;
+
+//
+// ESTRUCTURA: CARetiredSwapChain
+//
+// DESCRIPCIN: Swapchain sustituida al recrearla, con sus vistas y framebuffers. Su
+//              ltima presentacin puede seguir pendiente cuando termina el
+//              fotograma, as que se destruye cuando el timeline alcanza value: el
+//              valor de un fotograma que volvi a adquirir presentedImage, la primera
+//              imagen presentada en la swapchain nueva.
+//
+typedef struct
+{
+	std::function<void()> destroy;
+	uint32_t presentedImage;
+	bool acquired;
+	uint64_t value;
+} CARetiredSwapChain;
+
 class CAVulkanState
 {
 public:
-	CAVulkanState(GLFWwindow* window);
+	CAVulkanState(GLFWwindow* window, const CAPresentSettings& settings);
+	CAVulkanState(int width, int height, const CAPresentSettings& settings);
 	~CAVulkanState();
 	void windowResized(int width, int height);
+	void waitForFrameSlot();
 	void draw();
+	void finish();
+	void saveImage(const char* path);
 	void setModel(CAModel* model);
+	void markInput();
+	CAPresentSettings getPresentSettings();
+	void setPresentSettings(const CAPresentSettings& settings);
+	CALatencyStats getLatencyStats();
 
 	// Mtodos de gestin de buffers
-	void createVertexBuffer(size_t size, const void* data, CAVertexBuffer* vbo);
-	void destroyVertexBuffer(CAVertexBuffer vbo);
-	void createIndexBuffer(size_t size, const void* data, CAIndexBuffer* ibo);
-	void destroyIndexBuffer(CAIndexBuffer ibo);
 	void createUniformBuffer(size_t size, CAUniformBuffer* ubo);
-	void updateUniformBuffer(size_t size, const void* data, CAUniformBuffer ubo);
+	void updateUniformBuffer(size_t size, const void* data, const CAUniformBuffer& ubo);
 	void destroyUniformBuffer(CAUniformBuffer ubo);
-	void createDescriptorSets(VkDescriptorPool* descriptorPool, std::vector<VkDescriptorSet> *descriptorSets, CAUniformBuffer** buffers,size_t* bufferSizes, size_t size);
-	void destroyDescriptorSets(VkDescriptorPool descriptorPool, std::vector<VkDescriptorSet> descriptorSets);
+	VkDescriptorSet getDescriptorSet(VkDescriptorSetLayout layout, VkDescriptorType type, const std::vector<VkDescriptorBufferInfo>& buffers);
+	void releaseDescriptorSets(VkBuffer buffer);
+	void updateSceneUniform(const CASceneInfo& scene);
+	uint32_t registerMaterial(const CAMaterial& material);
+	CAMesh createMesh(const std::vector<CAVertex>& vertices, const std::vector<uint16_t>& indices);
+	void releaseMesh(const CAMesh& mesh);
+	void addDraw(const CAMesh& mesh, const CAInstance* instances, uint32_t instanceCount);
+	int32_t addPalette(const std::vector<glm::mat4>& matrices);
+	CAMemoryStats getMemoryStats();
 	VkPipelineLayout getPipelineLayout();
 
 private:
@@ -37,78 +116,245 @@ private:
 	int wHeight;
 	uint32_t imageCount;
 	uint32_t frameCount;
+	bool headless;
 
 	CAModel* model;
+	CAJobSystem* jobs;
 	GLFWwindow* window;
 	VkSurfaceKHR surface;
 	VkInstance instance;
 	VkPhysicalDevice physicalDevice;
 	VkPhysicalDeviceMemoryProperties memProperties;
 	VkDevice device;
+	CAMemoryAllocator* allocator;
+	CADescriptorAllocator* descriptors;
+	std::vector<CADescriptorAllocator*> frameDescriptors;
+	std::vector<uint64_t> frameSetGenerations;
+	std::map<std::vector<uint64_t>, VkDescriptorSet> descriptorCache;
 	uint32_t graphicsQueueFamilyIndex;
 	uint32_t presentQueueFamilyIndex;
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
 	VkSwapchainKHR swapChain;
 	std::vector<VkImage> swapChainImages;
+	std::vector<VkDeviceMemory> offscreenMemories;
 	VkFormat swapChainImageFormat;
+	VkPresentModeKHR presentMode;
 	VkExtent2D swapChainExtent;
 	std::vector<VkImageView> swapChainImageViews;
 	VkRenderPass renderPass;
-	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorSetLayout sceneSetLayout;
+	VkDescriptorSetLayout materialSetLayout;
+	VkDescriptorSetLayout instanceSetLayout;
 	VkPipeline graphicsPipeline;
+	VkPipelineCache pipelineCache;
 	VkPipelineLayout pipelineLayout;
-	std::vector<VkImage> depthImages;
-	std::vector<VkDeviceMemory> depthImageMemories;
-	std::vector<VkImageView> depthImageViews;
+	VkImage depthImage;
+	VkDeviceMemory depthImageMemory;
+	VkImageView depthImageView;
 	std::vector<VkFramebuffer> swapChainFramebuffers;
 	VkCommandPool commandPool;
 	std::vector<VkCommandBuffer> commandBuffers;
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	std::vector<VkSemaphore> renderFinishedSemaphores;
-	std::vector<VkFence> inFlightFences;
-	std::vector<VkFence> imagesInFlight;
+	VkSemaphore timeline;
+	std::vector<uint64_t> frameValues;
+	uint64_t submittedValue;
+	uint64_t completedValue;
+	CADeletionQueue deletionQueue;
+	std::vector<CARetiredSwapChain> retiredSwapChains;
+	bool recordingFrame;
+	std::vector<std::function<void()>> frameDestroys;
+
+	// Control de latencia: opciones, limitador y medida entrada-presentacin
+	CAPresentSettings settings;
+	bool slotReady;
+	bool inputPending;
+	bool frameHasInput;
+	std::chrono::steady_clock::time_point inputTime;
+	std::chrono::steady_clock::time_point frameInputTime;
+	std::chrono::steady_clock::time_point frameStart;
+	std::chrono::steady_clock::time_point nextFrameDeadline;
+	std::chrono::steady_clock::duration cpuFrameTime;
+	std::chrono::steady_clock::time_point lastLatencyReport;
+	CALatencyStats latencyStats;
 	size_t currentFrame = 0;
 	uint32_t currentImage = 0;
 	bool framebufferResized = false;
+	bool multiDrawIndirect;
+	bool indirectDraws;
+
+	// Subida de la geometra a memoria local del dispositivo
+	bool stagedGeometry;
+	VkBuffer stagingBuffer;
+	CAAllocation stagingMemory;
+	char* stagingData;
+	VkDeviceSize stagingSize;
+	VkDeviceSize stagingHead;
+	VkDeviceSize stagingBatchBegin;
+	VkCommandPool uploadCommandPool;
+	std::vector<VkCommandBuffer> uploadCommandBuffers;
+	std::deque<CAUploadBatch> uploadBatches;
+	std::vector<VkBuffer> uploadTargets;
+	std::vector<VkBufferCopy> uploadRegions;
+
+	// Buffers comunes con la geometra de todas las mallas estticas
+	VkBuffer geometryVertexBuffer;
+	VkBuffer geometryIndexBuffer;
+	CAAllocation geometryVertexMemory;
+	CAAllocation geometryIndexMemory;
+	uint32_t vertexCapacity;
+	uint32_t indexCapacity;
+	std::vector<CAVertex> geometryVertices;
+	std::vector<uint16_t> geometryIndices;
+	std::vector<CAGeometryRange> freeVertexRanges;
+	std::vector<CAGeometryRange> freeIndexRanges;
+
+	// Lista de dibujo del fotograma: comandos indirectos, instancias y paleta (una copia por fotograma en vuelo)
+	std::vector<VkDrawIndexedIndirectCommand> drawCommands;
+	std::vector<CAInstance> drawInstances;
+	std::vector<glm::mat4> drawPalette;
+	CAUniformBuffer drawBuffer;
+	CAUniformBuffer instanceBuffer;
+	CAUniformBuffer paletteBuffer;
+	std::vector<VkDescriptorSet> instanceSets;
+	uint32_t drawCapacity;
+	uint32_t instanceCapacity;
+	uint32_t paletteCapacity;
+
+	// Variables uniformes comunes a la escena (una copia por imagen)
+	CAUniformBuffer sceneBuffer;
+	std::vector<VkDescriptorSet> sceneSets;
+
+	// Tabla de materiales: storage buffer indexado con el material de cada instancia
+	VkBuffer materialBuffer;
+	CAAllocation materialMemory;
+	VkDescriptorSet materialSet;
+	uint32_t materialCapacity;
+	std::vector<CAMaterial> materials;
+	bool materialsDirty;
+
+	// Rangos de memoria no coherente escritos en el fotograma actual
+	std::vector<VkMappedMemoryRange> mappedRanges;
 
 	// Mtodos de inicializacin de Vulkan
+	void initialize(const CAPresentSettings& settings);
 	void createInstance();
 	void createSurface(GLFWwindow* window);
 	void pickPhysicalDevice();
 	void createLogicalDevice();
 	void createSwapChain();
+	void createOffscreenImages();
+	void destroyOffscreenImages();
 	void createImageViews();
 	void createRenderPass();
 	void createPipelineLayout();
 	void createGraphicsPipeline();
-	void createDepthBuffers();
+	void createDepthBuffer();
+	void destroyDepthBuffer();
 	void createFramebuffers();
 	void createCommandPool();
 	void createCommandBuffers();
 	void createSyncObjects();
+	void destroySyncObjects();
+	void createTimeline();
+	void destroyTimeline();
+	void waitForValue(uint64_t value);
+	void deferDestroy(const std::function<void()>& destroy);
 	void recreateSwapChain();
-	void fillCommandBuffers();
+	void collectRetiredSwapChains(bool all);
+	void recreateOffscreenImages();
+	void createFrameResources();
+	void destroyFrameResources();
+
+	// Grabacin de los command buffers en paralelo (un pool por fotograma y trabajo).
+	// recordGeneration cambia cada vez que se recrea un recurso enlazado en los
+	// secundarios; primaryPartitions y primaryImages guardan cuntos ejecuta el
+	// primario de cada fotograma y sobre qu imagen se grab.
+	uint32_t recordPoolCount;
+	uint64_t recordGeneration;
+	std::vector<CARecordPool> recordPools;
+	std::vector<std::vector<CARecordedPartition>> recordedPartitions;
+	std::vector<uint32_t> primaryPartitions;
+	std::vector<uint32_t> primaryImages;
+	std::vector<uint8_t> partitionDirty;
+	std::vector<VkResult> recordResults;
+	std::vector<VkCommandBuffer> partitionBuffers;
+	void createRecordPools();
+	void destroyRecordPools();
+	void recordCommandBuffer(uint32_t frame, uint32_t image);
+	VkResult recordPartition(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t firstDraw, uint32_t drawCount);
+	bool isPartitionDirty(const CARecordedPartition& partition, uint32_t firstDraw, uint32_t drawCount);
 
 	// Mtodos de definicin del pipeline de renderizado
 	void createVertexShaderStageCreateInfo(VkShaderModule* vertShaderModule, VkPipelineShaderStageCreateInfo* vertShaderStageInfo);
 	void createFragmentShaderStageCreateInfo(VkShaderModule* fragShaderModule, VkPipelineShaderStageCreateInfo* fragShaderStageInfo);
 	void createPipelineVertexInputStateCreateInfo(VkPipelineVertexInputStateCreateInfo* vertexInputInfo, VkVertexInputBindingDescription* bindingDescriptions, VkVertexInputAttributeDescription* attributeDescriptions);
 	void createPipelineInputAssemblyStateCreateInfo(VkPipelineInputAssemblyStateCreateInfo* inputAssembly);
-	void createPipelineViewportStateCreateInfo(VkPipelineViewportStateCreateInfo* viewportState, VkViewport* viewport, VkRect2D* scissor);
+	void createPipelineViewportStateCreateInfo(VkPipelineViewportStateCreateInfo* viewportState);
+	void createPipelineDynamicStateCreateInfo(VkPipelineDynamicStateCreateInfo* dynamicState, VkDynamicState* dynamicStates);
 	void createPipelineRasterizationStateCreateInfo(VkPipelineRasterizationStateCreateInfo* rasterizer);
 	void createPipelineMultisampleStateCreateInfo(VkPipelineMultisampleStateCreateInfo* multisampling);
 	void createPipelineDepthStencilStateCreateInfo(VkPipelineDepthStencilStateCreateInfo* depthStencil);
 	void createPipelineColorBlendStateCreateInfo(VkPipelineColorBlendAttachmentState* colorBlendAttachment, VkPipelineColorBlendStateCreateInfo* colorBlending);
 
+	// Mtodos de gestin de buffers
+	void createFrameBuffers(size_t size, VkBufferUsageFlags usage, CAUniformBuffer* ubo);
+
+	// Mtodos de subida de la geometra
+	void createStagingRing();
+	void destroyStagingRing();
+	void createStagingBuffer(VkDeviceSize size);
+	void createGeometryArena(uint32_t vertexCapacity, uint32_t indexCapacity);
+	void destroyGeometryArena();
+	void resizeGeometryArena(uint32_t vertexCapacity, uint32_t indexCapacity);
+	void writeGeometry(VkBuffer dst, const CAAllocation& memory, VkDeviceSize dstOffset, size_t size, const void* data);
+	void stageCopy(VkBuffer dst, VkDeviceSize dstOffset, size_t size, const void* data);
+	VkDeviceSize allocateStaging(VkDeviceSize size);
+	void flushUploads();
+	void retireUploads();
+	void waitForUploads();
+	uint32_t allocateGeometryRange(std::vector<CAGeometryRange>& ranges, uint32_t count);
+	void freeGeometryRange(std::vector<CAGeometryRange>& ranges, uint32_t first, uint32_t count);
+	void flushMappedRanges();
+
+	// Mtodos de gestin de descriptores
+	void createDescriptorAllocators();
+	void destroyDescriptorAllocators();
+	void createFrameDescriptors();
+	void destroyFrameDescriptors();
+	void writeDescriptorSet(VkDescriptorSet set, VkDescriptorType type, const std::vector<VkDescriptorBufferInfo>& buffers);
+	VkDescriptorSet allocateFrameDescriptorSet(VkDescriptorSetLayout layout);
+	void updateFrameDescriptorSets();
+
+	// Mtodos de la lista de dibujo
+	void createDrawList(uint32_t drawCapacity, uint32_t instanceCapacity, uint32_t paletteCapacity);
+	void destroyDrawList();
+	void uploadDraws();
+	void addDrawCommands(VkCommandBuffer commandBuffer, uint32_t index, uint32_t firstDraw, uint32_t drawCount);
+	void createSceneUniform();
+	void destroySceneUniform();
+
+	// Mtodos de la tabla de materiales
+	void createMaterialTable(uint32_t capacity);
+	void destroyMaterialTable();
+	void uploadMaterials();
+
+	// Mtodos de la cach de pipelines
+	void createPipelineCache();
+	void destroyPipelineCache();
+
 	// Mtodos de generacin de la imagen
 	void waitForNextImage();
 	void submitGraphicsCommands();
 	void submitPresentCommands();
+	void limitFrameRate();
+	void measureLatency();
 
 	// Mtodos auxiliares
 	bool isDeviceSuitable(VkPhysicalDevice pDevice);
 	VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
+	VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 	VkShaderModule createShaderModule(const std::vector<char>& code);
 	std::vector<char> getFileFromResource(int resource);
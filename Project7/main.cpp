@@ -1,17 +1,74 @@
 #include "CAApplication.h"
 #include <iostream>
 #include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+//
+// FUNCIN: printUsage(const char* program)
+//
+// PROPSITO: Muestra cmo se invoca el programa
+//
+static void printUsage(const char* program)
+{
+	std::cerr << "usage: " << program << " [--headless <frames> [--dump <file.ppm>]]" << std::endl;
+}
+
+//
+// FUNCIN: parseFrames(const char* text, uint32_t* frames)
+//
+// PROPSITO: Lee el nmero de fotogramas. Slo admite un entero positivo que quepa
+//            en 32 bits y sin caracteres sobrantes.
+//
+static bool parseFrames(const char* text, uint32_t* frames)
+{
+	if (text[0] < '0' || text[0] > '9') return false;
+
+	char* end;
+	errno = 0;
+	unsigned long long value = strtoull(text, &end, 10);
+	if (errno != 0 || *end != '\0' || value == 0 || value > UINT32_MAX) return false;
+
+	*frames = (uint32_t)value;
+	return true;
+}
 
 //
 // PROYECTO: Project7
 //
 // DESCRIPCIN: Aade una articulacin de tipo balljoint
 //              Define una escena con una cruz y dos articulaciones
+//              Con --headless <fotogramas> genera sin ventana y muestra el rendimiento;
+//              con --dump <fichero.ppm> guarda adems la ltima imagen
 //
-int main()
+int main(int argc, char** argv)
 {
 	CAApplication app;
 
+	if (argc > 1)
+	{
+		uint32_t frames = 0;
+		bool valid = (argc == 3 || argc == 5) && strcmp(argv[1], "--headless") == 0 && parseFrames(argv[2], &frames);
+		if (valid && argc == 5) valid = strcmp(argv[3], "--dump") == 0;
+		if (!valid)
+		{
+			printUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		try
+		{
+			app.runHeadless(frames, argc == 5 ? argv[4] : nullptr);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
 	try
 	{
 		app.run();
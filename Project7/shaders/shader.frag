@@ -3,43 +3,43 @@
 
 layout(location = 0) in vec3 Position;
 layout(location = 1) in vec3 Normal;
+layout(location = 2) flat in uint MaterialIndex;
 
 layout(location = 0) out vec4 outColor;
 
-layout(binding = 0) uniform TransformInfo {
-    mat4 MVP;
+layout(set = 0, binding = 0) uniform SceneInfo {
     mat4 ViewMatrix;
-    mat4 ModelViewMatrix;
-} Transform;
+    mat4 ProjectionMatrix;
+    vec3 Ldir;
+    vec3 La;
+    vec3 Ld;
+    vec3 Ls;
+} Scene;
 
-layout(binding = 1) uniform LightInfo 
-{
-	vec3 Ldir;
-	vec3 La;
-	vec3 Ld;
-	vec3 Ls;
-} Light;
-
-layout(binding = 2) uniform MaterialInfo 
+struct MaterialInfo 
 {
 	vec3 Ka;
 	vec3 Kd;
 	vec3 Ks;
 	float Shininess;
-} Material;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer MaterialTable {
+	MaterialInfo Materials[];
+};
 
  vec3 ads() 
  {
-  	vec4 s4 = Transform.ViewMatrix*vec4(Light.Ldir, 0.0);
+	MaterialInfo Material = Materials[MaterialIndex];
 	vec3 n = normalize(Normal);
 	vec3 v = normalize(-Position);
-	vec3 s = normalize(-vec3(s4));
+	vec3 s = normalize(-Scene.Ldir);
 	vec3 r = reflect(-s, n);
 	float dRate = max(dot(s, n), 0.0);
 	float sRate = pow(max(dot(r, v), 0.0), Material.Shininess);
-	vec3 ambient = Light.La * Material.Ka;
-	vec3 difusse = Light.Ld * Material.Kd * dRate;
-	vec3 specular = Light.Ls * Material.Ks * sRate;
+	vec3 ambient = Scene.La * Material.Ka;
+	vec3 difusse = Scene.Ld * Material.Kd * dRate;
+	vec3 specular = Scene.Ls * Material.Ks * sRate;
 	return ambient + difusse + specular;
  }
 
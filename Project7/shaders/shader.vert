@@ -1,23 +1,55 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 0) uniform TransformInfo {
-    mat4 MVP;
+layout(set = 0, binding = 0) uniform SceneInfo {
     mat4 ViewMatrix;
-    mat4 ModelViewMatrix;
-} Transform;
+    mat4 ProjectionMatrix;
+    vec3 Ldir;
+    vec3 La;
+    vec3 Ld;
+    vec3 Ls;
+} Scene;
+
+struct InstanceInfo {
+    mat4 ModelMatrix;
+    uint MaterialIndex;
+    int PaletteBase;
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer InstanceTable {
+    InstanceInfo Instances[];
+};
+
+layout(std430, set = 2, binding = 1) readonly buffer PaletteTable {
+    mat4 Palette[];
+};
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
+layout(location = 2) in uint inJoint;
+layout(location = 3) in uint inMaterial;
 
 layout(location = 0) out vec3 Position;
 layout(location = 1) out vec3 Normal;
+layout(location = 2) flat out uint MaterialIndex;
 
 void main() 
 {
-	vec4 n4 = Transform.ModelViewMatrix*vec4(inNormal, 0.0);
-	vec4 v4 = Transform.ModelViewMatrix*vec4(inPosition,1.0);
+	InstanceInfo Instance = Instances[gl_InstanceIndex];
+	mat4 ModelMatrix = Instance.ModelMatrix;
+	MaterialIndex = Instance.MaterialIndex;
+
+	// Esqueleto horneado: cada vrtice se mueve con la matriz de su articulacin
+	if (Instance.PaletteBase >= 0)
+	{
+		ModelMatrix = Palette[Instance.PaletteBase + int(inJoint)];
+		MaterialIndex = inMaterial;
+	}
+
+	mat4 ModelViewMatrix = Scene.ViewMatrix * ModelMatrix;
+	vec4 n4 = ModelViewMatrix*vec4(inNormal, 0.0);
+	vec4 v4 = ModelViewMatrix*vec4(inPosition,1.0);
 	Normal = vec3(n4);
 	Position = vec3(v4);
-	gl_Position = Transform.MVP * vec4(inPosition, 1.0);
+	gl_Position = Scene.ProjectionMatrix * v4;
 }
\ No newline at end of file